@@ -0,0 +1,481 @@
+/*++
+/* NAME
+/*	arena 3
+/* SUMMARY
+/*	Size-classed arena allocator.
+/* SYNOPSIS
+/*	#include <arena.h>
+/*
+/*	void	*arena_alloc(sz, kind);
+/*	size_t	sz;
+/*	int	kind;
+/*
+/*	int	arena_kind(ptr);
+/*	const void *ptr;
+/*
+/*	bool	arena_mark(ptr);
+/*	const void *ptr;
+/*
+/*	bool	arena_marked(ptr);
+/*	const void *ptr;
+/*
+/*	size_t	arena_sweep();
+/*
+/*	size_t	arena_live();
+/*
+/*	void	arena_report(stream);
+/*	FILE	*stream;
+/*
+/*	void	arena_attach();
+/*
+/*	size_t	arena_size(sz);
+/*	size_t	sz;
+/*
+/*	void	arena_walk(visit);
+/*	void	(*visit)(const void *ptr, int kind, size_t sz);
+/* DESCRIPTION
+/*	The evaluator allocates a great many small objects: expressions,
+/*	values, functions, thunks, environments and bindings. Calling
+/*	malloc() once for each of them is slow and scatters related
+/*	objects across the heap.
+/*
+/*	arena_alloc() rounds each request, plus a one word header, up
+/*	to a multiple of ARENA_ALIGN and serves it from a chunk reserved
+/*	for that size class. Slots released by arena_sweep() are reused
+/*	first; otherwise the slot is taken by bumping a pointer. A new
+/*	chunk of ARENA_CHUNK_SIZE bytes is obtained from the system only
+/*	when the current chunk of a class is used up, so objects of the
+/*	same kind end up next to each other in memory. The header records
+/*	kind, which must not be ARENA_FREE, for the garbage collector.
+/*	Requests larger than ARENA_MAX_SIZE are rare; each gets its own
+/*	block from malloc(), with the same header, on a list of large
+/*	objects.
+/*
+/*	arena_kind() returns the kind an object was allocated with.
+/*
+/*	arena_mark() sets the mark bit of an object. It returns true if
+/*	the object was not marked before. arena_marked() tests the mark
+/*	bit of an object without setting it.
+/*
+/*	arena_sweep() releases every object that is not marked and
+/*	clears the mark bit of the others. It returns the number of
+/*	bytes released.
+/*
+/*	arena_live() returns the number of bytes in use.
+/*
+/*	Each thread has size classes of its own, which it registers with
+/*	arena_attach(), so the worker threads of par(3) allocate without
+/*	locking. arena_sweep() sweeps the classes of every thread; it runs
+/*	while the other threads are stopped. The list of large objects is
+/*	locked.
+/*
+/*	arena_size() returns the number of bytes an object of sz bytes
+/*	takes in the arena, with its header. arena_walk() calls visit
+/*	with every object in use, its kind and the bytes it takes. After
+/*	a collection, these are the live objects.
+/*
+/*	arena_report() writes the number of objects and bytes allocated,
+/*	the number of chunks and bytes, including large objects,
+/*	obtained from the system, and the peak resident set size of the
+/*	process, as the system reports it, to stream.
+/* DIAGNOSTICS
+/*	Memory allocation errors are fatal errors.
+/*--*/
+
+#include <assert.h>
+#include <stdio.h>
+#include <wchar.h>
+#if defined(_WIN32)
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "arena.h"
+#include "par.h"
+
+
+ /* constants */
+
+#define NCLASSES  (ARENA_MAX_SIZE / ARENA_ALIGN)
+#define CHUNK_HDR ((sizeof(Chunk) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+
+
+ /* structure definitions */
+
+typedef struct Chunk  Chunk;
+typedef struct Class  Class;
+typedef struct Heap   Heap;
+typedef struct Header Header;
+typedef struct Slot   Slot;
+typedef struct Large  Large;
+
+struct Chunk {
+	Chunk *link;
+	char  *limit;		/* end of last slot */
+};
+
+struct Class {
+	char   *next;		/* next free byte in current chunk */
+	char   *limit;		/* end of current chunk */
+	Chunk  *chunks;		/* all chunks of this class, current first */
+	Slot   *free;		/* slots released by arena_sweep() */
+};
+
+struct Heap {			/* the classes of a thread */
+	Class         classes[NCLASSES];
+	unsigned long nobjects;	/* objects allocated */
+	unsigned long nbytes;	/* bytes allocated */
+	unsigned long nchunks;	/* chunks obtained from system */
+	size_t        nlive;	/* bytes in use, see arena_live() */
+};
+
+struct Header {
+	unsigned int kind;
+	unsigned int mark;
+};
+
+struct Slot {
+	Header hdr;
+	Slot  *link;
+};
+
+struct Large {
+	Large  *link;
+	size_t  size;
+	Header  hdr;
+};
+
+
+ /* static data */
+
+static THREAD_LOCAL Heap heap;
+static Heap  *heaps[PAR_MAX_THREADS];	/* see arena_attach() */
+
+static Large *large = 0;		/* large objects */
+static Mutex  large_lock = MUTEX_INITIALIZER;
+
+static size_t nlarge = 0;		/* bytes in large objects */
+
+
+/* size_class - returns the size class index of a request */
+
+static size_t size_class(size_t sz)
+{
+	return (sz + ARENA_ALIGN - 1) / ARENA_ALIGN - 1;
+}
+
+
+/* header - returns the header of an object */
+
+static Header *header(const void *ptr)
+{
+	return (Header *)ptr - 1;
+}
+
+
+/* new_chunk - obtains a new chunk for a size class */
+
+static void new_chunk(Class *cls, size_t sz)
+{
+	Chunk *chk = 0;
+
+	chk = (Chunk *)malloc(ARENA_CHUNK_SIZE);
+	assert(chk != 0);
+	chk->link   = cls->chunks;
+	chk->limit  = (char *)chk + CHUNK_HDR
+		+ ((ARENA_CHUNK_SIZE - CHUNK_HDR) / sz) * sz;
+	cls->chunks = chk;
+	cls->next   = (char *)chk + CHUNK_HDR;
+	cls->limit  = chk->limit;
+
+	++heap.nchunks;
+}
+
+
+/* large_alloc - allocates a large object */
+
+static Header *large_alloc(size_t sz)
+{
+	Large *obj = 0;
+
+	obj = (Large *)malloc(sizeof(*obj) + sz);
+	assert(obj != 0);
+	obj->size = sizeof(*obj) + sz;
+	par_lock(&large_lock);
+	obj->link = large;
+	large = obj;
+	nlarge += obj->size;
+	par_unlock(&large_lock);
+
+	return &obj->hdr;
+}
+
+
+/* large_sweep - releases unmarked large objects */
+
+static size_t large_sweep(void)
+{
+	Large **ptr = &large, *obj = 0;
+	size_t  freed = 0;
+
+	while ((obj = *ptr) != 0) {
+		if (obj->hdr.mark) {
+			obj->hdr.mark = 0;
+			ptr = &obj->link;
+		} else {
+			*ptr = obj->link;
+			freed  += obj->size;
+			nlarge -= obj->size;
+			free(obj);
+		}
+	}
+
+	return freed;
+}
+
+
+/* arena_alloc - allocate memory from the arena (or die) */
+
+void *arena_alloc(size_t sz, int kind)
+{
+	Class  *cls = 0;
+	Header *hdr = 0;
+
+	assert(sz > 0);
+	assert(kind != ARENA_FREE);
+
+	if (sz + sizeof(Header) > ARENA_MAX_SIZE) {
+		hdr = large_alloc(sz);
+		sz += sizeof(Large);
+		goto done;
+	}
+
+	sz  = size_class(sz + sizeof(Header));
+	cls = &heap.classes[sz];
+	sz  = (sz + 1) * ARENA_ALIGN;
+
+	if (cls->free != 0) {
+		hdr = &cls->free->hdr;
+		cls->free = cls->free->link;
+	} else {
+		if (cls->next == cls->limit) {
+			new_chunk(cls, sz);
+		}
+		hdr = (Header *)cls->next;
+		cls->next += sz;
+	}
+
+done:
+	hdr->kind = kind;
+	hdr->mark = 0;
+
+	++heap.nobjects;
+	heap.nbytes += sz;
+	heap.nlive  += sz;
+
+	return hdr + 1;
+}
+
+
+/* arena_kind - returns the kind of an object */
+
+int arena_kind(const void *ptr)
+{
+	assert(ptr != 0);
+	return header(ptr)->kind;
+}
+
+
+/* arena_mark - marks an object */
+
+bool arena_mark(const void *ptr)
+{
+	Header *hdr = header(ptr);
+
+	assert(hdr->kind != ARENA_FREE);
+
+	if (hdr->mark) {
+		return false;
+	}
+	hdr->mark = 1;
+	return true;
+}
+
+
+/* arena_marked - tests the mark bit of an object */
+
+bool arena_marked(const void *ptr)
+{
+	return header(ptr)->mark != 0;
+}
+
+
+/* sweep_heap - releases the unmarked objects in the classes of a
+   thread */
+
+static size_t sweep_heap(Heap *hp)
+{
+	Class  *cls = 0;
+	Chunk  *chk = 0;
+	char   *ptr = 0, *end = 0;
+	Slot   *slot = 0;
+	size_t  sz = 0, freed = 0;
+
+	for (cls = hp->classes; cls < hp->classes + NCLASSES; cls++) {
+		sz = (cls - hp->classes + 1) * ARENA_ALIGN;
+		cls->free = 0;
+		for (chk = cls->chunks; chk != 0; chk = chk->link) {
+			ptr = (char *)chk + CHUNK_HDR;
+			end = chk == cls->chunks ? cls->next : chk->limit;
+			for (; ptr < end; ptr += sz) {
+				slot = (Slot *)ptr;
+				if (slot->hdr.mark) {
+					slot->hdr.mark = 0;
+					continue;
+				}
+				if (slot->hdr.kind != ARENA_FREE) {
+					slot->hdr.kind = ARENA_FREE;
+					freed += sz;
+				}
+				slot->link = cls->free;
+				cls->free  = slot;
+			}
+		}
+	}
+
+	return freed;
+}
+
+
+/* arena_sweep - releases unmarked objects */
+
+size_t arena_sweep(void)
+{
+	size_t freed = 0, live = arena_live();
+	int    i;
+
+	for (i = 0; i <= par_threads; i++) {
+		freed += sweep_heap(heaps[i]);
+		heaps[i]->nlive = 0;
+	}
+	freed += large_sweep();
+	heaps[0]->nlive = live - freed;
+
+	return freed;
+}
+
+
+/* arena_live - returns bytes in use */
+
+size_t arena_live(void)
+{
+	size_t live = 0;
+	int    i;
+
+	for (i = 0; i <= par_threads; i++) {
+		live += heaps[i]->nlive;
+	}
+
+	return live;
+}
+
+
+/* arena_size - returns the bytes taken by an object of sz bytes */
+
+size_t arena_size(size_t sz)
+{
+	if (sz + sizeof(Header) > ARENA_MAX_SIZE) {
+		return sz + sizeof(Large);
+	}
+	return (size_class(sz + sizeof(Header)) + 1) * ARENA_ALIGN;
+}
+
+
+/* arena_walk - calls visit with every object in use */
+
+void arena_walk(void (*visit)(const void *ptr, int kind, size_t sz))
+{
+	Class  *cls = 0;
+	Chunk  *chk = 0;
+	Large  *obj = 0;
+	Header *hdr = 0;
+	char   *ptr = 0, *end = 0;
+	size_t  sz = 0;
+	int     i;
+
+	for (i = 0; i <= par_threads; i++) {
+		for (cls = heaps[i]->classes; cls < heaps[i]->classes + NCLASSES;
+		     cls++) {
+			sz = (cls - heaps[i]->classes + 1) * ARENA_ALIGN;
+			for (chk = cls->chunks; chk != 0; chk = chk->link) {
+				ptr = (char *)chk + CHUNK_HDR;
+				end = chk == cls->chunks ? cls->next : chk->limit;
+				for (; ptr < end; ptr += sz) {
+					hdr = (Header *)ptr;
+					if (hdr->kind != ARENA_FREE) {
+						visit(hdr + 1, hdr->kind, sz);
+					}
+				}
+			}
+		}
+	}
+	for (obj = large; obj != 0; obj = obj->link) {
+		visit(&obj->hdr + 1, obj->hdr.kind, obj->size);
+	}
+}
+
+
+/* arena_attach - registers the classes of the calling thread */
+
+void arena_attach(void)
+{
+	heaps[par_self()] = &heap;
+}
+
+
+/* peak_resident - returns the peak resident set size in kilobytes */
+
+static unsigned long peak_resident(void)
+{
+#if defined(_WIN32)
+	PROCESS_MEMORY_COUNTERS pmc;
+
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) {
+		return 0;
+	}
+	return (unsigned long)(pmc.PeakWorkingSetSize / 1024);
+#else
+	struct rusage ru;
+
+	if (getrusage(RUSAGE_SELF, &ru) != 0) {
+		return 0;
+	}
+#if defined(__APPLE__)
+	return (unsigned long)(ru.ru_maxrss / 1024);	/* in bytes */
+#else
+	return (unsigned long)ru.ru_maxrss;
+#endif
+#endif
+}
+
+
+/* arena_report - reports allocation figures */
+
+void arena_report(FILE *stream)
+{
+	unsigned long nobjects = 0, nbytes = 0, nchunks = 0;
+	int i;
+
+	for (i = 0; i <= par_threads; i++) {
+		nobjects += heaps[i]->nobjects;
+		nbytes   += heaps[i]->nbytes;
+		nchunks  += heaps[i]->nchunks;
+	}
+	fwprintf(stream, L";; %lu objects, %lu bytes allocated"
+		L" in %lu chunks (%lu bytes)\n",
+		nobjects, nbytes, nchunks,
+		nchunks * ARENA_CHUNK_SIZE + (unsigned long)nlarge);
+	fwprintf(stream, L";; %lu KB peak resident\n", peak_resident());
+}
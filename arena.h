@@ -0,0 +1,38 @@
+#ifndef _ARENA_H_INCLUDED_
+#define _ARENA_H_INCLUDED_
+#include <stdio.h>
+#include <stdlib.h>
+#include "types.h"
+/*++
+/* NAME
+/*	arena 3h
+/* SUMMARY
+/*	Size-classed arena allocator.
+/* DESCRIPTION
+/* .nf
+
+ /* constants */
+
+#define ARENA_ALIGN       (8)		/* size class granularity */
+#define ARENA_MAX_SIZE    (512)		/* largest object in the arena */
+#define ARENA_CHUNK_SIZE  (64 * 1024)	/* bytes per chunk */
+#define ARENA_FREE        (0)		/* kind of an unused slot */
+
+
+ /* Function prototypes */
+
+void	*arena_alloc(size_t sz, int kind);
+int	 arena_kind(const void *ptr);
+bool	 arena_mark(const void *ptr);
+bool	 arena_marked(const void *ptr);
+size_t	 arena_sweep(void);
+size_t	 arena_live(void);
+void	 arena_report(FILE *stream);
+void	 arena_attach(void);
+size_t	 arena_size(size_t sz);
+void	 arena_walk(void (*visit)(const void *ptr, int kind, size_t sz));
+
+/* AUTHOR
+/*	Brent Harp
+/*--*/
+#endif
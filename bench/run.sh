@@ -0,0 +1,52 @@
+#!/bin/sh
+# run.sh - time the benchmark workloads
+#
+# usage: sh bench/run.sh [interpreter [flags...]]
+#
+# Runs each workload once with --alloc-stats, --gc-stats and --stats and
+# writes one tab-separated line per workload to the standard output,
+# headed by the column names, so the output of two commits can be
+# compared with diff(1) or join(1). Reductions are the functions and
+# builtins applied, as counted by stats(3). The interpreter defaults to ./a.out; any further
+# arguments (e.g. --vm) are passed to it for every workload.
+
+lc=${1:-./a.out}
+[ $# -gt 0 ] && shift
+dir=$(dirname "$0")
+tmp=${TMPDIR:-/tmp}/bench.$$
+trap 'rm -f "$tmp".*' 0 1 2 15
+
+# The large prelude: 50000 definitions, each calling the one before.
+awk 'BEGIN {
+	print "f0 = \\x.x."
+	for (i = 1; i < 50000; i++)
+		printf "; definition %d\nf%d = \\x.(f%d (add %d x)).\n", i, i, i - 1, i
+}' > "$tmp.prelude"
+echo "(f1000 0)." > "$tmp.query"
+
+# run name input [flags...] - run one workload and print its line
+run() {
+	name=$1 input=$2
+	shift 2
+	"$lc" "$@" --alloc-stats --gc-stats --stats < "$input" 2> "$tmp.err" > /dev/null
+	status=$?
+	awk -v name="$name" -v status=$status '
+		/ functions applied, /	{ reductions = $2 + $5 }
+		/ thunks promised, /	{ thunks = $2 }
+		/ objects, /	{ objects = $2; bytes = $4 }
+		/ KB peak /	{ peak = $2 }
+		/ s elapsed$/	{ wall = $2 }
+		/ collections, /	{ collections = $2 }
+		END {
+			if (status != 0)
+				wall = "failed(" status ")"
+			printf "%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\n", name, wall,
+			    reductions, thunks, objects, bytes, collections, peak
+		}' "$tmp.err"
+}
+
+printf 'workload\twall_s\treductions\tthunks\tobjects\tbytes\tcollections\tpeak_kb\n'
+for f in church fix lists par; do
+	run $f "$dir/$f.l" "$@"
+done
+run prelude "$tmp.query" --prelude "$tmp.prelude" "$@"
@@ -6,13 +6,28 @@
 /* SYNOPSIS
 /*  #include <env.h>
 /*  
-/*  const Value *lookup(const wchar_t * name, Env * env)
-/*  Env *link(const wchar_t *name, const Value *value, Env *env)
-/*  const Value *bind(const wchar_t *name, const Value *value, Env *env)
+/*  const Value *lookup(Symbol name, Env * env)
+/*  Env *link(Symbol name, const Value *value, Env *env)
+/*  const Value *bind(Symbol name, const Value *value, Env *env)
+/*  const Value *lookup_local(int depth, Env *env)
+/*  const Value *lookup_global(int slot)
+/*  int global_slot(Symbol name)
+/*  void scan_env(const Env *env)
+/*  void scan_binding(const Binding *bnd)
+/*  Globals *new_globals(void)
+/*  void free_globals(Globals *g)
+/*  Globals *use_globals(Globals *g)
+/*  Symbol global_binding(int slot, const Value **value)
+/*  void set_global(int slot, const Value *value)
+/*  Env *make_env(Env *link)
+/*  const Binding *put_binding(Env *env, Symbol name, const Value *value)
+/*  Env *env_link(const Env *env)
+/*  const Binding *next_binding(const Env *env, const Binding *bnd,
+/*                              Symbol *name, const Value **value)
 /* DESCRIPTION
 /*  lookup() searches an environment for a named value. Names are
-/*  compared by wcscmp(). If a match is found (wcscmp returns 0) then
-/*  the value is returned. Otherwise, lookup() searches the next
+/*  interned symbols (see symbol(3)) and are compared by identity. If
+/*  a match is found then the value is returned. Otherwise, lookup() searches the next
 /*  environment by following the environment's link pointer.
 /*
 /*  link() binds name to value in a new environment. If name is already
@@ -21,7 +36,46 @@
 /*  returns the old value.
 /*
 /*  bind() binds name to value in the environment env. Any previous binding
-/*  of name in the environment is destroyed.
+/*  of name in the environment is destroyed. A function that has no name
+/*  yet takes name, which print(3) and the profilers show; one that has a
+/*  name keeps it, as it may be shared with other jobs (see eval(3)).
+/*
+/*  The global environment is not a list of bindings like the frames
+/*  made by link(). Each global name has a slot, found through an
+/*  open-addressing hash table keyed by the interned name, so looking
+/*  up a free variable does not depend on the number of definitions,
+/*  and bind() replaces the value of a redefined name in place.
+/*
+/*  lookup_local() returns the value bound by the frame depth levels up
+/*  from env, counting env itself as level 0. Frames made by link() bind
+/*  a single name, so this finds a lambda parameter by its lexical
+/*  address (see resolve(3)) without comparing names.
+/*
+/*  global_slot() returns the slot number of a name in the global
+/*  environment, allocating a new, unbound slot on first use.
+/*  lookup_global() returns the value bound to the name of a slot.
+/*
+/*  The slots belong to a global context. Every thread starts in the
+/*  first context; the batch mode of eval(3) gives each job a context
+/*  of its own, so jobs running side by side do not see each other's
+/*  definitions. new_globals() makes a context that starts with the
+/*  bindings of the current one, so names keep their slot numbers
+/*  and expressions resolved in one context run in the other.
+/*  use_globals() makes a context current in the calling thread, or
+/*  the first one if g is 0, and returns the context it replaces.
+/*  free_globals() frees a context that is no longer current. The
+/*  environment returned by get_global_environment() stands for the
+/*  current context, whichever it is.
+/*
+/*  The remaining functions take environments apart and put them
+/*  together again, for the images of image(3). global_binding()
+/*  returns the name and the value of a slot of the current context,
+/*  without failing on an unbound name, and set_global() sets the
+/*  value of a slot without renaming the function it holds, as
+/*  bind() does. make_env() makes an empty frame, and put_binding()
+/*  adds a binding to it, in front of the others. env_link() returns
+/*  the parent of a frame, and next_binding() steps through its
+/*  bindings from the first.
 /* RETURN VALUE
 /*  lookup() returns a constant value if name is bound in the 
 /*  environment, otherwise it returns 0;
@@ -31,30 +85,44 @@
 /*
 /*  bind() returns the bound value.
 /*
+/*  lookup_local() and lookup_global() return a constant value.
+/*
 /*  get_global_environment() returns a reference to the global environment.
+/*
+/*  scan_env() and scan_binding() mark the objects referred to by an
+/*  environment or a binding for the garbage collector. Scanning the
+/*  global environment marks the values of all global slots, in
+/*  every context.
+/* DIAGNOSTICS
+/*  Looking up an unbound variable is an error (see fail() in eval(3)).
 /*--*/
 
 #include <assert.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
-#include "mystdlib.h"
+#include "gc.h"
 #include "types.h"
 #include "env.h"
+#include "eval.h"
+#include "par.h"
 #include "print.h"
+#include "stats.h"
+#include "heap.h"
 
 
  /* function prototypes */
 
-static const Binding *get_binding(Env *, const wchar_t *);
-static const Binding *make_binding(const wchar_t *, const Value *, const Binding *);
-static const Binding *put_binding(Env *, const wchar_t *, const Value *);
-static       Env     *make_env(Env *);
+static const Binding *get_binding(Env *, Symbol);
+static const Binding *make_binding(Symbol, const Value *, const Binding *);
+static       void     print_globals(FILE *, const wchar_t *, const wchar_t *);
 
 
  /* structure definitions */
 
 struct Binding {
-	const wchar_t *name;
+	Symbol name;
 	const Value *value;
 	const Binding *link;
 };
@@ -65,9 +133,28 @@ struct Env {
 };
 
 
+ /* global environment */
+
+struct Globals {
+	Symbol       *names;		/* name of each slot */
+	const Value **values;		/* value of each slot */
+	int           n;
+	int           max;
+	int          *index;		/* hash table of slot numbers */
+	int           index_size;	/* a power of 2 */
+	Globals      *link;		/* next context */
+};
+
+static Env     *global = 0;		/* shared by all contexts */
+static Globals  first  = { 0, 0, 0, 0, 0, 0, 0 };
+static Mutex    lock   = MUTEX_INITIALIZER;	/* guards the list */
+
+static THREAD_LOCAL Globals *globals = &first;	/* the current context */
+
+
 /* make_binding - makes a new binding */
 
-static const Binding *make_binding(const wchar_t *name,
+static const Binding *make_binding(Symbol name,
                              const Value   *val,
 							 const Binding *lnk)
 {
@@ -76,10 +163,13 @@ static const Binding *make_binding(const wchar_t *name,
 	assert(name != 0);
 	assert(val  != 0);
 
-	bnd = (Binding *)mymalloc(sizeof(*bnd));
+	bnd = (Binding *)gc_alloc(K_Binding, sizeof(*bnd));
 	bnd->name  = name;
 	bnd->value = val;
 	bnd->link  = lnk;
+	if (heap_profiling) {
+		heap_note(bnd, sizeof(*bnd));
+	}
 
 	return bnd;
 }
@@ -87,43 +177,102 @@ static const Binding *make_binding(const wchar_t *name,
 
 /* make_env - makes a new environment */
 
-static Env *make_env(Env *link)
+Env *make_env(Env *link)
 {
 	Env *env = 0;
 
-	env = mymalloc(sizeof(*env));
+	env = gc_alloc(K_Env, sizeof(*env));
 	env->bindings = UNBOUND;
 	env->link     = link;
+	if (heap_profiling) {
+		heap_note(env, sizeof(*env));
+	}
 
 	return env;
 }
 
 
-/* get_binding - returns the binding of name in env. If name is not
-   bound, inserts name into environment as an unbound symbol. */
+/* get_binding - returns the binding of name in the local frames of
+   env, or UNBOUND if name is not bound locally. */
 
-static const Binding *get_binding(Env *env, const wchar_t *name)
+static const Binding *get_binding(Env *env, Symbol name)
 {
 	const Binding *bnd = UNBOUND;
+	unsigned long  n   = 0;		/* bindings passed */
 
 	assert(env  != 0);
 	assert(name != 0);
 
-	for (; env != 0; env = env->link) {
+	for (; env != 0 && env != global; env = env->link) {
 		for (bnd = env->bindings; bnd != UNBOUND; bnd = bnd->link) {
-			if (wcscmp(bnd->name, name) == 0) {
+			if (bnd->name == name) {
 				goto found;
 			}
+			STAT(++n);
 		}
 	}
 found:
+	STAT_WALK(n);
+	return bnd;
+}
+
+
+/* env_link - returns the parent of an environment */
+
+Env *env_link(const Env *env)
+{
+	return env->link;
+}
+
+
+/* next_binding - returns the binding of an environment after bnd, or
+   its first binding if bnd is 0, and its name and value */
+
+const Binding *next_binding(const Env *env, const Binding *bnd,
+			    Symbol *name, const Value **value)
+{
+	bnd = bnd == 0 ? env->bindings : bnd->link;
+	if (bnd != UNBOUND) {
+		*name  = bnd->name;
+		*value = bnd->value;
+	}
+
 	return bnd;
 }
 
 
+/* scan_env - marks the bindings and parent of an environment */
+
+void scan_env(const Env *env)
+{
+	const Globals *g = 0;
+	int i;
+
+	gc_mark(env->bindings);
+	gc_mark(env->link);
+
+	if (env == global) {
+		for (g = &first; g != 0; g = g->link) {
+			for (i = 0; i < g->n; i++) {
+				gc_mark(g->values[i]);
+			}
+		}
+	}
+}
+
+
+/* scan_binding - marks the value and successor of a binding */
+
+void scan_binding(const Binding *bnd)
+{
+	gc_mark(bnd->value);
+	gc_mark(bnd->link);
+}
+
+
 /* put_binding - inserts a new binding into an environment */
 
-static const Binding *put_binding(Env *env, const wchar_t *name, const Value *val)
+const Binding *put_binding(Env *env, Symbol name, const Value *val)
 {
 	assert(env  != 0);
 	assert(name != 0);
@@ -133,12 +282,36 @@ static const Binding *put_binding(Env *env, const wchar_t *name, const Value *va
 }
 
 
+/* print_globals - prints the bound slots of the global environment */
+
+static void print_globals(FILE *stream, const wchar_t *before,
+			  const wchar_t *between)
+{
+	int i;
+	bool first = true;
+
+	for (i = 0; i < globals->n; i++) {
+		if (globals->values[i] == 0) {
+			continue;
+		}
+		if (!first) {
+			fputws(between, stream);
+		}
+		fputws(before, stream);
+		fputws(globals->names[i], stream);
+		fputwc(L'=', stream);
+		print_value(globals->values[i], stream);
+		first = false;
+	}
+}
+
+
 /* print_locals - prints one level of bindings */
 
 void print_locals(Env *env, FILE *stream)
 {
 	const Binding *bnd = 0;
-	static bool rec = false;
+	static THREAD_LOCAL bool rec = false;
 
 	assert(env != 0);
 	assert(stream != 0);
@@ -159,6 +332,10 @@ void print_locals(Env *env, FILE *stream)
 		}
 	}
 
+	if (env == global) {
+		print_globals(stream, L"", L",");
+	}
+
 	rec = false;
 }
 
@@ -168,7 +345,7 @@ void print_locals(Env *env, FILE *stream)
 void print_env(Env *env, FILE *stream)
 {
 	const Binding *bnd = 0;
-	static bool rec = 0;
+	static THREAD_LOCAL bool rec = 0;
 
 	if (rec == 1) {
 		fputws(L"...", stream);
@@ -188,6 +365,9 @@ void print_env(Env *env, FILE *stream)
 				fputwc(L',', stream);
 			}
 		}
+		if (env == global) {
+			print_globals(stream, L" ", L",");
+		}
 	}
 
 	rec = 0;
@@ -198,20 +378,28 @@ void print_env(Env *env, FILE *stream)
 
 /* bind - binds name to value in an environment */
 
-const Value *bind(const wchar_t *name, const Value *value, Env *env)
+const Value *bind(Symbol name, const Value *value, Env *env)
 {
 	Binding *bnd = 0;
+	int slot;
 
 	assert(env   != 0);
 	assert(name  != 0);
 	assert(value != 0);
 
 	if (value->type == T_Function) {
-		value->data.function->name = name;
+		/* only the first name, as other threads may see it */
+		CAS_PTR(&value->data.function->name, 0, name);
 	}
 
-	/* create new binding */
-	put_binding(env, name, value);
+	if (env == get_global_environment()) {
+		/* replace the value of the global slot */
+		slot = global_slot(name);
+		STORE_PTR(&globals->values[slot], value);
+	} else {
+		/* create new binding */
+		put_binding(env, name, value);
+	}
 
 	return value;
 }
@@ -220,7 +408,7 @@ const Value *bind(const wchar_t *name, const Value *value, Env *env)
 /* link -  Binds name to value in a new environment. Returns the new
 	environment. */
 
-Env *link(const wchar_t *name, const Value *value, Env *env)
+Env *link(Symbol name, const Value *value, Env *env)
 {
 	Env *new_env = 0;
 
@@ -229,6 +417,7 @@ Env *link(const wchar_t *name, const Value *value, Env *env)
 
 	new_env = make_env(env);
 	put_binding(new_env, name, value);
+	STAT(++counts.linked);
 
 	return new_env;
 }
@@ -236,21 +425,231 @@ Env *link(const wchar_t *name, const Value *value, Env *env)
 
 /* lookup - Looks up a value by name in an environment.  */
 
-const Value *lookup(const wchar_t * name, Env * env)
+const Value *lookup(Symbol name, Env * env)
 {
 	const Binding *bnd = UNBOUND;
 	const Value   *val = 0;
 
 	if ((bnd = get_binding(env, name)) != UNBOUND) {
 		val = bnd->value;
+	} else {
+		val = lookup_global(global_slot(name));
 	}
 
+	if (val == 0) {
+		abandon();
+	}
 	assert(val != 0);
 
 	return val;
 }
 
-static Env *global = 0;
+/* lookup_local - Looks up a value by lexical address. */
+
+const Value *lookup_local(int depth, Env *env)
+{
+	assert(env != 0);
+
+	STAT_WALK((unsigned long)depth);
+	for (; depth > 0; depth--) {
+		env = env->link;
+		assert(env != 0);
+	}
+
+	assert(env->bindings != UNBOUND);
+
+	return env->bindings->value;
+}
+
+
+/* hash - hashes an interned name */
+
+static unsigned int hash(Symbol name)
+{
+	return (unsigned int)(((size_t)name >> 3) * 2654435761u);
+}
+
+
+/* find_slot - returns the hash table entry of a name */
+
+static int *find_slot(Symbol name)
+{
+	unsigned int i, mask = globals->index_size - 1;
+
+	for (i = hash(name) & mask; globals->index[i] >= 0; i = (i + 1) & mask) {
+		if (globals->names[globals->index[i]] == name) {
+			break;
+		}
+	}
+
+	return &globals->index[i];
+}
+
+
+/* grow_index - doubles the size of the global hash table */
+
+static void grow_index(void)
+{
+	int i;
+
+	globals->index_size = globals->index_size != 0 ? 2 * globals->index_size : 512;
+	free(globals->index);
+	globals->index = malloc(globals->index_size * sizeof(*globals->index));
+	assert(globals->index != 0);
+
+	for (i = 0; i < globals->index_size; i++) {
+		globals->index[i] = -1;
+	}
+	for (i = 0; i < globals->n; i++) {
+		*find_slot(globals->names[i]) = i;
+	}
+}
+
+
+/* global_slot - returns the global slot of a name */
+
+int global_slot(Symbol name)
+{
+	int *entry = 0;
+
+	assert(name != 0);
+
+	if (2 * (globals->n + 1) > globals->index_size) {
+		grow_index();
+	}
+
+	if (*(entry = find_slot(name)) >= 0) {
+		return *entry;
+	}
+
+	if (globals->n == globals->max) {
+		globals->max = globals->max != 0 ? 2 * globals->max : 256;
+		globals->names = realloc(globals->names,
+			globals->max * sizeof(*globals->names));
+		globals->values = realloc(globals->values,
+			globals->max * sizeof(*globals->values));
+		assert(globals->names != 0 && globals->values != 0);
+	}
+
+	globals->names[globals->n]  = name;
+	globals->values[globals->n] = 0;
+	*entry = globals->n;
+
+	return globals->n++;
+}
+
+
+/* lookup_global - Looks up the value of a global slot. */
+
+const Value *lookup_global(int slot)
+{
+	const Value *val = 0;
+
+	assert(0 <= slot && slot < globals->n);
+
+	val = LOAD_PTR(&globals->values[slot]);
+
+	if (val == 0) {
+		abandon();
+		fwprintf(stderr, L"%s: unbound variable: ", "eval");
+		fputws(globals->names[slot], stderr);
+		fputwc(L'\n', stderr);
+		fail();
+	}
+
+	return val;
+}
+
+
+/* global_binding - returns the name of a global slot, and its value,
+   which is 0 if the name is unbound; returns 0 past the last slot */
+
+Symbol global_binding(int slot, const Value **value)
+{
+	if (slot >= globals->n) {
+		return 0;
+	}
+	*value = globals->values[slot];
+
+	return globals->names[slot];
+}
+
+
+/* set_global - sets the value of a global slot */
+
+void set_global(int slot, const Value *value)
+{
+	assert(0 <= slot && slot < globals->n);
+	assert(value != 0);
+
+	STORE_PTR(&globals->values[slot], value);
+}
+
+
+/* new_globals - makes a global context holding the bindings of the
+   current one */
+
+Globals *new_globals(void)
+{
+	const Globals *from = globals;
+	Globals       *g = calloc(1, sizeof(*g));
+
+	assert(g != 0);
+
+	g->n = g->max = from->n;
+	g->index_size = from->index_size;
+	g->names  = malloc((g->max + 1) * sizeof(*g->names));
+	g->values = malloc((g->max + 1) * sizeof(*g->values));
+	g->index  = malloc((g->index_size + 1) * sizeof(*g->index));
+	assert(g->names != 0 && g->values != 0 && g->index != 0);
+
+	memcpy(g->names, from->names, g->n * sizeof(*g->names));
+	memcpy(g->values, from->values, g->n * sizeof(*g->values));
+	memcpy(g->index, from->index, g->index_size * sizeof(*g->index));
+
+	par_lock(&lock);
+	g->link = first.link;
+	first.link = g;
+	par_unlock(&lock);
+
+	return g;
+}
+
+
+/* free_globals - frees a global context made by new_globals() */
+
+void free_globals(Globals *g)
+{
+	Globals *p = 0;
+
+	assert(g != &first && g != globals);
+
+	par_lock(&lock);
+	for (p = &first; p->link != g; p = p->link) {
+		assert(p->link != 0);
+	}
+	p->link = g->link;
+	par_unlock(&lock);
+
+	free(g->names);
+	free(g->values);
+	free(g->index);
+	free(g);
+}
+
+
+/* use_globals - makes a global context current in the calling thread,
+   and returns the one it replaces; 0 selects the first context */
+
+Globals *use_globals(Globals *g)
+{
+	Globals *old = globals;
+
+	globals = g != 0 ? g : &first;
+
+	return old;
+}
+
 
 Env *get_global_environment()
 {
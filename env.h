@@ -16,12 +16,27 @@
 
  /* Function prototypes */
 
-const Value *lookup(const wchar_t *name, Env * env);
-Env *link(const wchar_t *name, const Value *value, Env *env);
-const Value *bind(const wchar_t *name, const Value *value, Env *env);
+const Value *lookup(Symbol name, Env * env);
+Env *link(Symbol name, const Value *value, Env *env);
+const Value *bind(Symbol name, const Value *value, Env *env);
+const Value *lookup_local(int depth, Env *env);
+const Value *lookup_global(int slot);
+int global_slot(Symbol name);
 Env *get_global_environment();
 void print_env(Env * env, FILE *stream);
 void print_locals(Env * env, FILE *stream);
+void scan_env(const Env *env);
+void scan_binding(const Binding *bnd);
+Globals *new_globals(void);
+void free_globals(Globals *g);
+Globals *use_globals(Globals *g);
+Symbol global_binding(int slot, const Value **value);
+void set_global(int slot, const Value *value);
+Env *make_env(Env *link);
+const Binding *put_binding(Env *env, Symbol name, const Value *value);
+Env *env_link(const Env *env);
+const Binding *next_binding(const Env *env, const Binding *bnd,
+			    Symbol *name, const Value **value);
 
 /* AUTHOR
 /*	Brent Harp
@@ -14,7 +14,31 @@
 /*
 /*	const Value *force(const Value *val);
 /*
+/*	const Value *compress(const Value *val);
+/*
+/*	bool cheap(const Exp *exp);
+/*
+/*	void blackhole(Thunk *thk);
+/*
 /*	const Exp *expand(const Exp *exp, Env *env);
+/*
+/*	void scan_eval(void);
+/*
+/*	void eval_attach(void);
+/*
+/*	bool speculate(const Value *val);
+/*
+/*	void abandon(void);
+/*
+/*	void fail(void);
+/*
+/*	void *the(Type type, const Value *val);
+/*
+/*	const wchar_t *builtin_name(Procedure proc);
+/*
+/*	Procedure builtin_procedure(const wchar_t *name);
+/*
+/*	int max_depth;
 /* DESCRIPTION
 /*	This module evaluates expressions in the lambda calculus.
 /*
@@ -30,13 +54,173 @@
 /*	the saved environment. The result of calling the thunk is saved, so
 /*	calling force() again will return the same value.
 /*
+/*	A thunk whose expression evaluates to another thunk takes that
+/*	thunk as its value, so evaluated thunks may form chains.
+/*	compress() returns the end of the chain starting at val, and
+/*	points every thunk on the chain at the end, so later forcing
+/*	does not walk the chain again.
+/*
+/*	blackhole() marks a thunk as under evaluation, by dropping its
+/*	expression and environment, before the thunk is evaluated. An
+/*	evaluated thunk keeps only its value, so it no longer retains
+/*	the environment it was made in. Forcing a thunk that is under
+/*	evaluation means its value depends on itself: blackhole() then
+/*	reports <<loop>> instead of evaluating it again.
+/*
+/*	An argument that is a lambda parameter, a quotation, a number or
+/*	a lambda is as cheap to evaluate as to promise, and cheap()
+/*	tests for one. Such arguments are passed evaluated, without a
+/*	thunk. A free variable is still promised, as its global binding
+/*	may change before the argument is forced.
+/*
+/*	The REPL writes the reports of the other modules and the wall
+/*	clock time the program ran for with the --alloc-stats option.
+/*	The counters of stats(3), among them the functions applied by
+/*	either engine, the arguments passed without a thunk and the
+/*	thunk chain links removed by compress(), are reported at exit
+/*	with the --stats option, and whenever the stats builtin is
+/*	applied; it returns its argument.
+/*
 /*	expand() returns a fully expanded form of an expression.
+/*
+/*	scan_eval() marks the objects referred to by the continuation
+/*	stack for the garbage collector.
+/*
+/*	Numbers evaluate to native numbers, values of type T_Num. A native
+/*	number is converted to its Church encoding, a function of f and x
+/*	that applies f to x n times, only when it is applied. See num(3)
+/*	for the builtin arithmetic on native numbers.
+/*
+/*	call() applies a value, which may be a native number, to an
+/*	argument. It is used by builtins that call back into lambda
+/*	calculus code.
+/*
+/*	builtin_name() returns the name of the procedure of a builtin,
+/*	including the curried builtins of num(3), and builtin_procedure()
+/*	returns the procedure of a name; image(3) writes builtins by
+/*	name. Each returns 0 for anything else.
+/*
+/*	eval() and force() do not recurse in C. They run a machine whose
+/*	continuations are kept on a stack of their own, which grows on
+/*	the heap: evaluating the operator of an application, the first
+/*	expression of a sequence, or a thunk pushes a continuation, and
+/*	applying a function or evaluating the second expression of a
+/*	sequence does not, so tail calls run in constant space. Deep
+/*	evaluations are limited only by max_depth, the maximum number of
+/*	continuations, which is set with the --max-depth option; 0 means
+/*	no limit. The builtins of num(3) have their argument forced to a
+/*	native number on that stack before they are applied, a Church
+/*	numeral by applying it to succ and 0. Other builtins, and the
+/*	machine of vm(3), still call back into the evaluator in C, each
+/*	time on a run of the machine nested in the one that called them;
+/*	runs nest at most EVAL_MAX_NESTING deep on a thread, so that the
+/*	C stack does not overflow.
+/*
+/*	The REPL and the load builtin evaluate statements with execute(),
+/*	which uses eval() or, when the --vm option is given, the bytecode
+/*	machine of vm(3). Thunks made by either engine may be forced by
+/*	force(). With the --normalize option the REPL prints the normal
+/*	form of the value of each expression (see norm(3)) instead of its
+/*	weak head normal form, and echoes assignments as usual; --steps sets the step budget of normalization. With the
+/*	--inet option it prints the normal form of each expression found
+/*	by the interaction net reducer of inet(3), and records each
+/*	assignment for it as well as evaluating it.
+/*
+/*	The load builtin keeps the files it has loaded with module(3):
+/*	loading a file again evaluates only the statements that changed
+/*	since, and those that depend on them, and nothing if the file
+/*	did not change.
+/*
+/*	With the --par option, promise() offers each thunk of an
+/*	application to the worker threads of par(3). Every thread has a
+/*	continuation stack and thunk counts of its own, which it registers
+/*	with eval_attach(). A thread takes a thunk for evaluation by
+/*	swapping its expression for 0 with an atomic compare and swap,
+/*	which is how blackhole() marks it, so a thunk is evaluated once
+/*	however many threads force it. A thread that forces a thunk taken
+/*	by another thread waits until its value is stored, or until the
+/*	thunk is given back; waiting for a thunk the thread itself took is
+/*	<<loop>>.
+/*
+/*	speculate() forces a thunk on a worker and returns true, or gives
+/*	up and returns false. abandon() gives up a speculative
+/*	evaluation: it gives every thunk the worker took back its
+/*	expression and environment, which the worker keeps on its stack
+/*	for the purpose, and returns from speculate(). On the main thread
+/*	abandon() does nothing. A worker gives up before it prints, loads
+/*	a file, normalizes or assigns, where it would fail with an error,
+/*	after waiting too long for another thread, and when par_quiesce()
+/*	is called. The main thread waits as long as it takes.
+/*
+/*	Given source files as arguments, the program runs in batch mode
+/*	instead of reading statements from stdin: each file is a job,
+/*	evaluated like a session of the REPL but without the echo, and
+/*	its values, and whatever it prints, are written to a file named
+/*	like the source file with .l replaced by .out. The -j option
+/*	runs that many jobs at a time, on the threads of par_batch() (see
+/*	par(3)). Each job has a global context of its own (see env(3)),
+/*	made from the context the --prelude file is loaded into before
+/*	the jobs start, so the jobs share the prelude and its evaluated
+/*	thunks, but not each other's definitions. The thunks of the
+/*	prelude not evaluated by then are frozen: a job that forces one
+/*	evaluates a copy of its own, in its own context, so what a job
+/*	sees does not depend on the order the jobs run in. The
+/*	continuation stack, the print stream, the files loaded (see
+/*	module(3)) and the printing state of print(3) and env(3) belong
+/*	to the thread.
+/*
+/*	The --profile option samples the named functions being applied
+/*	with profile(3), and writes their collapsed stacks to a file at
+/*	exit. run() tells the profiler of each application of a named
+/*	function, and of each return to a continuation; it works with
+/*	the tree walker on a single thread only.
+/*
+/*	The --heap-profile option accounts for the memory of the
+/*	evaluator with heap(3), charging each top-level statement that
+/*	execute() evaluates, and reports it at exit; the heap builtin
+/*	reports it whenever it is applied, and returns its argument.
+/*
+/*	The --trace option records a timeline of the top-level
+/*	statements of the REPL, the calls of load, and the applications
+/*	of named functions and evaluations of thunks that take longer
+/*	than --trace-min microseconds, with trace(3), and writes it to a
+/*	file at exit.
+/*
+/*	The --image option starts the global environment from an image
+/*	(see image(3)), before the --prelude file is loaded, instead of
+/*	the builtins alone; --dump-image writes an image of it when the
+/*	program ends, after the session on stdin or, in batch mode, of
+/*	the context the jobs start from. An image of a library is made
+/*	by running the program with the library on stdin, and loads in
+/*	a fraction of the time it takes to read and evaluate it again.
+/*
+/*	the() returns the object of a value of type, and fails with an
+/*	error naming the type, such as "eval: not a function", if the
+/*	value has another type.
+/*
+/*	fail() is called after an error has been reported. In a job it
+/*	gives every thunk under evaluation back, and abandons the job,
+/*	which is reported as failed while the other jobs go on; the
+/*	program then exits with a failure status once all jobs are done.
+/*	In the session on stdin it gives the thunks back in the same way,
+/*	and the REPL gives up the statement and reads the next one.
+/*	Otherwise, as while the --prelude file is loaded, fail() exits.
+/* DIAGNOSTICS
+/*	Exceeding max_depth or EVAL_MAX_NESTING is an error. So is forcing a thunk that is
+/*	under evaluation, which is reported as <<loop>>, and applying a
+/*	value that is not a function.
 /*--*/
 
 #include <assert.h>
+#include <setjmp.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
-#include "mystdlib.h"
+#include "arena.h"
+#include "gc.h"
 #include "types.h"
 #include "read.h"
 #include "eval.h"
@@ -45,11 +229,67 @@
 #include "exp.h"
 #include "print.h"
 #include "num.h"
+#include "symbol.h"
+#include "stats.h"
+#include "profile.h"
+#include "heap.h"
+#include "trace.h"
+#include "resolve.h"
+#include "vm.h"
+#include "norm.h"
+#include "inet.h"
+#include "par.h"
+#include "image.h"
+#include "module.h"
 
 
 /* function prototypes */
 
 static const Value *make_thunk(const Exp *exp, Env *env);
+static const Value *run(const Exp *exp, Env *env, const Value *val);
+static const Value *argument(const Exp *exp, Env *env);
+static bool claim(Thunk *thk, const Exp **exp, Env **env,
+		  const Code **code);
+static const Value *await(const Value *val);
+
+
+ /* continuations */
+
+enum Kont_Kind {
+	C_Base,			/* return from run() */
+	C_Force,		/* force the value */
+	C_Update,		/* store the value in a thunk */
+	C_Apply,		/* apply the value to a promise of exp */
+	C_Seq,			/* discard the value, then evaluate exp */
+	C_Assign,		/* bind the name of exp to the value */
+	C_Num			/* apply the builtin in env to the number */
+};
+
+typedef struct Kont Kont;
+
+struct Kont {
+	enum Kont_Kind kind;
+	const Exp     *exp;	/* C_Update: of the thunk, when speculating;
+				   C_Num: not 0 once converted */
+	Env           *env;
+	Thunk         *thunk;	/* C_Update only */
+};
+
+typedef struct Copy Copy;
+
+struct Copy {			/* a job's copy of a frozen thunk, see thaw() */
+	const Value *thunk;	/* of the prelude; 0: a free slot */
+	const Value *copy;
+};
+
+typedef struct Machine Machine;
+
+struct Machine {		/* the state of a thread, see eval_attach() */
+	Kont         **konts;
+	int           *kp;
+	Copy         **copies;
+	int           *scopies;
+};
 
 static const Value *make_function(const Exp *param, const Exp *body,
 		Env *env);
@@ -57,80 +297,543 @@ static const Value *make_function(const Exp *param, const Exp *body,
 const Value *promise(const Exp *exp, Env *env);
 
 const Value *print(const Function *fn, const Value *arg);
+const Value *load(const Function *fn, const Value *arg);
+const Value *show_stats(const Function *fn, const Value *arg);
+const Value *show_heap(const Function *fn, const Value *arg);
+
+static const Value *execute(const Exp *exp, Env *env);
+static const Value *thaw(const Value *val);
+
+
+ /* static data */
+
+static bool use_vm = false;		/* evaluate with vm(3) */
+static bool use_inet = false;		/* print normal forms with inet(3) */
+
+static THREAD_LOCAL Kont *konts  = 0;	/* continuation stack */
+static THREAD_LOCAL int   kp     = 0;
+static THREAD_LOCAL int   nkonts = 0;
+static THREAD_LOCAL int   nested = 0;	/* runs of run() on the C stack */
+
+static THREAD_LOCAL bool     speculating = false;	/* on a worker */
+static THREAD_LOCAL jmp_buf *abandoned   = 0;	/* see speculate() */
+static THREAD_LOCAL jmp_buf *failed      = 0;	/* see run_job() */
+static THREAD_LOCAL FILE    *output      = 0;	/* of print, or stdout */
+
+static const Value       **frozen  = 0;	/* see freeze(), by address */
+static int                 nfrozen = 0;
+static int                 sfrozen = 0;
+static THREAD_LOCAL Copy  *copies  = 0;	/* of the job, see thaw() */
+static THREAD_LOCAL int    ncopies = 0;
+static THREAD_LOCAL int    scopies = 0;
+
+static bool          normal_form = false;	/* print normal forms */
+static const char  **jobs        = 0;		/* files of the batch */
+static long          nfailed     = 0;		/* jobs that failed */
+
+static Machine machines[PAR_MAX_THREADS];
+
+static const struct {
+	const wchar_t *name;
+	Procedure      proc;
+	bool           global;	/* bound in the global environment */
+} builtins[] = {
+	{ L"print",     print,        true },
+	{ L"load",      load,         true },
+	{ L"stats",     show_stats,   true },
+	{ L"heap",      show_heap,    true },
+	{ L"succ",      num_succ,     true },
+	{ L"pred",      num_pred,     true },
+	{ L"add",       num_add,      true },
+	{ L"mul",       num_mul,      true },
+	{ L"iszero",    num_iszero,   true },
+	{ L"equal",     num_equal,    true },
+	{ L"less",      num_less,     true },
+	{ L"normalize", norm_builtin, true },
+	{ L"add2",      num_add2,     false },	/* curried, see num(3) */
+	{ L"mul2",      num_mul2,     false },
+	{ L"equal2",    num_equal2,   false },
+	{ L"less2",     num_less2,    false },
+	{ 0, 0, false }
+};
+
+#define AWAIT_LIMIT 10000		/* pauses before a worker gives up */
+
+int max_depth = EVAL_MAX_DEPTH;		/* 0: no limit */
+
+#define NUM_SMALL 256
+
+static const Value *small[NUM_SMALL];	/* shared small numbers */
+
+static const Exp *numeral[2];		/* succ and 0, see C_Num */
+static Env       *numeral_env = 0;	/* binds succ */
 
 
 /* the - check type */
 
 void *the(Type type, const Value *val)
 {
-	assert(val->type == type);
+	static const char *const names[] = {
+		"an expression", "a function", "a thunk", "an environment",
+		"a number"
+	};
+
+	if (val->type != type) {
+		abandon();
+		fwprintf(stderr, L"%s: not %s\n", "eval", names[type]);
+		fail();
+	}
 	return (void *)val->data.function;
 }
 
 
-/* eval - evaluate an expression */
+/* push_kont - pushes a continuation */
 
-const Value *eval(const Exp * exp, Env * env)
+static void push_kont(enum Kont_Kind kind, const Exp *exp, Env *env,
+		      Thunk *thk)
 {
-	const Value *op = 0, *lhs = 0, *rhs = 0, *val = 0;
-	const Function *fn;
-	static int indent = 0;
-	int i = 0;
+	Kont *k = 0;
+
+	if (kp == nkonts) {
+		if (max_depth > 0 && kp >= max_depth) {
+			abandon();
+			fwprintf(stderr, L"%s: evaluation depth exceeds %d\n",
+				"eval", max_depth);
+			fail();
+		}
+		nkonts = nkonts != 0 ? 2 * nkonts : 1024;
+		if (max_depth > 0 && nkonts > max_depth) {
+			nkonts = max_depth;
+		}
+		konts = realloc(konts, nkonts * sizeof(*konts));
+		assert(konts != 0);
+	}
+
+	k = &konts[kp++];
+	k->kind  = kind;
+	k->exp   = exp;
+	k->env   = env;
+	k->thunk = thk;
+}
+
 
+/* run - evaluates exp in env, or forces val if exp is 0 */
+
+static const Value *run(const Exp *exp, Env *env, const Value *val)
+{
+	const Value    *op   = 0;
+	const Value    *copy = 0;
+	const Function *fn   = 0;
+	const Code     *code = 0;
+	Thunk          *thk  = 0;
+	Kont            k;
+	int             base = kp;
+	bool            undo = speculating || failed != 0;
+
+	if (nested >= EVAL_MAX_NESTING) {
+		abandon();
+		fwprintf(stderr, L"%s: evaluation nests deeper than %d\n",
+			"eval", EVAL_MAX_NESTING);
+		fail();
+	}
+	++nested;
+
+	gc_protect(&exp);
+	gc_protect(&env);
+	gc_protect(&val);
+
+	push_kont(C_Base, 0, 0, 0);
+	if (exp == 0) {
+		push_kont(C_Force, 0, 0, 0);
+		goto ret;
+	}
+
+eval:
 	assert(exp != 0);
 	assert(env != 0);
 
+	gc_poll();
+	STAT(++counts.evals[exp->type]);
+
 	switch (exp->type) {
 	case T_Exp_Symbol:
 		val = lookup(exp->sval, env);
-		break;
+		goto ret;
+
+	case T_Exp_Local:
+		val = lookup_local(exp->nval, env);
+		goto ret;
+
+	case T_Exp_Global:
+		val = lookup_global(exp->nval);
+		goto ret;
 
 	case T_Exp_Lambda:
 		assert(exp->child[0] != 0);
 		assert(exp->child[1] != 0);
 		assert(exp->child[0]->type == T_Exp_Symbol);
 		val = make_function(exp->child[0], exp->child[1], env);
-		break;
+		goto ret;
 
 	case T_Exp_Pair:
-		op  = force(eval(exp->child[0], env));
-		fn  = (Function *) the(T_Function, op);
-		val = fn->apply(fn, promise(exp->child[1], env));
-		break;
+		push_kont(C_Apply, exp->child[1], env, 0);
+		push_kont(C_Force, 0, 0, 0);
+		exp = exp->child[0];
+		goto eval;
 
 	case T_Exp_Quote:
 		val = make_exp_value(exp->child[0]);
-		break;
+		goto ret;
 
 	case T_Exp_Assign:
 		assert(exp->child[0] != 0);
 		assert(exp->child[1] != 0);
 		assert(exp->child[0]->type == T_Exp_Symbol);
 		assert(exp->child[0]->sval != 0);
-		val = bind(exp->child[0]->sval, eval(exp->child[1], env), env);
-		break;
+		push_kont(C_Assign, exp->child[0], env, 0);
+		exp = exp->child[1];
+		goto eval;
 
 	case T_Exp_Seq:
 		assert(exp->child[0] != 0);
 		assert(exp->child[1] != 0);
-		force(eval(exp->child[0], env));
-		val = force(eval(exp->child[1], env));
-		break;
+		push_kont(C_Seq, exp->child[1], env, 0);
+		push_kont(C_Force, 0, 0, 0);
+		exp = exp->child[0];
+		goto eval;
 
 	case T_Exp_Num:
-		val = eval(church_encode(exp->nval), env);
-		break;
+		val = make_num_value(exp->num);
+		goto ret;
 
 	default:
 		fwprintf(stderr, L"%s: %d: %s: illegal expression type\n",
 			__FILE__, __LINE__, "eval");
 		exit(EXIT_FAILURE);
 	}
-	
+
+ret:
+	assert(val != 0);
+	assert(kp > base);
+
+	if (profiling) {
+		profile_leave(kp);
+	}
+
+	switch (konts[kp - 1].kind) {
+	case C_Force:
+		if (val->type == T_Thunk) {
+			val = compress(val);
+			STAT(val->type != T_Thunk && ++counts.cached);
+		}
+		if (val->type != T_Thunk) {
+			--kp;
+			goto ret;
+		}
+		if (nfrozen > 0 && (copy = thaw(val)) != val) {
+			/* force the job's copy instead */
+			val = copy;
+			goto ret;
+		}
+		thk = val->data.thunk;
+		if (!claim(thk, &exp, &env, &code)) {
+			/* another thread has it: wait, then force again */
+			val = await(val);
+			goto ret;
+		}
+		STAT(++counts.forced);
+		if (code != 0) {
+			/* compiled: the continuation only serves unwind(),
+			   which gives the thunk back uncompiled */
+			push_kont(C_Update, undo ? exp : 0, undo ? env : 0, thk);
+			val = vm_run(code, env);
+			--kp;
+			STORE_PTR(&thk->value, val);
+		} else {
+			/* evaluate the thunk, then force again; keep what
+			   unwind() needs to give it back */
+			if (tracing) {
+				trace_force(kp);
+			}
+			push_kont(C_Update, undo ? exp : 0, undo ? env : 0, thk);
+			goto eval;
+		}
+		goto ret;
+
+	case C_Update:
+		STORE_PTR(&konts[--kp].thunk->value, val);
+		if (tracing) {
+			trace_forced(kp);
+		}
+		goto ret;
+
+	case C_Apply:
+		op = val;
+		if (op->type == T_Num) {
+			op = church_value(op->data.num);
+		}
+		fn  = (Function *) the(T_Function, op);
+		k   = konts[--kp];
+		val = argument(k.exp, k.env);
+		STAT_APPLY(fn);
+		if (profiling && fn->name != 0) {
+			profile_enter(fn->name, kp);
+		}
+		if (fn->apply == apply) {
+			/* a tail call: no continuation is kept */
+			env = link(fn->param->sval, val, fn->env);
+			exp = fn->body;
+			goto eval;
+		}
+		if (val->type != T_Num && num_strict(fn->apply)) {
+			/* force the number here, not in num_of(), which
+			   would run the machine again in C */
+			push_kont(C_Num, 0, link(fn->name, op, 0), 0);
+			push_kont(C_Force, 0, 0, 0);
+			goto ret;
+		}
+		val = fn->apply(fn, val);
+		goto ret;
+
+	case C_Num:
+		k  = konts[--kp];
+		fn = lookup_local(0, k.env)->data.function;
+		if (val->type == T_Function && k.exp == 0) {
+			/* a Church numeral: apply it to succ and 0, and
+			   come back with the native number */
+			push_kont(C_Num, numeral[0], k.env, 0);
+			push_kont(C_Force, 0, 0, 0);
+			push_kont(C_Apply, numeral[1], numeral_env, 0);
+			push_kont(C_Force, 0, 0, 0);
+			push_kont(C_Apply, numeral[0], numeral_env, 0);
+			goto ret;
+		}
+		/* num_of() reports anything but a number */
+		val = fn->apply(fn, val);
+		goto ret;
+
+	case C_Seq:
+		k   = konts[--kp];
+		exp = k.exp;
+		env = k.env;
+		goto eval;
+
+	case C_Assign:
+		abandon();
+		k   = konts[--kp];
+		val = bind(k.exp->sval, val, k.env);
+		goto ret;
+
+	case C_Base:
+		--kp;
+		assert(kp == base);
+		break;
+	}
+
+	gc_unprotect(3);
+	--nested;
+
 	return val;
 }
 
 
+/* scan_eval - marks the objects on the continuation stacks */
+
+void scan_eval(void)
+{
+	const Kont *ks = 0;
+	const Copy *cs = 0;
+	int i, j;
+
+	for (j = 0; j <= par_threads; j++) {
+		ks = *machines[j].konts;
+		for (i = 0; i < *machines[j].kp; i++) {
+			gc_mark(ks[i].exp);
+			gc_mark(ks[i].env);
+			if (ks[i].thunk != 0) {
+				gc_mark(VALUE_OF(ks[i].thunk));
+			}
+		}
+		cs = *machines[j].copies;
+		for (i = 0; i < *machines[j].scopies; i++) {
+			gc_mark(cs[i].copy);
+		}
+	}
+	for (i = 0; i < nfrozen; i++) {
+		gc_mark(frozen[i]);
+	}
+	for (i = 0; i < NUM_SMALL; i++) {
+		gc_mark(small[i]);
+	}
+	gc_mark(numeral[0]);
+	gc_mark(numeral[1]);
+	gc_mark(numeral_env);
+}
+
+
+/* eval_attach - registers the state of the calling thread */
+
+void eval_attach(void)
+{
+	Machine *m = &machines[par_self()];
+	int      i;
+
+	m->konts       = &konts;
+	m->kp          = &kp;
+	m->copies      = &copies;
+	m->scopies     = &scopies;
+
+	if (par_self() == 0 && par_threads > 0) {
+		/* made up front, so the workers need not race for them */
+		for (i = 0; i < NUM_SMALL; i++) {
+			make_num_value(i);
+		}
+	}
+}
+
+
+/* claim - takes the expression, environment and code of a thunk
+   for evaluation, or returns false if another evaluation has them */
+
+static bool claim(Thunk *thk, const Exp **exp, Env **env,
+		  const Code **code)
+{
+	if (par_threads == 0) {
+		*exp  = thk->exp;
+		*env  = thk->env;
+		*code = thk->code;
+		blackhole(thk);
+		return true;
+	}
+
+	*exp = LOAD_PTR(&thk->exp);
+	if (*exp == 0 || !CAS_PTR(&thk->exp, *exp, 0)) {
+		return false;
+	}
+	*env  = thk->env;
+	*code = thk->code;
+	thk->env  = 0;
+	thk->code = 0;
+
+	return true;
+}
+
+
+/* await - waits until a thunk claimed by another thread is evaluated
+   or given up */
+
+static const Value *await(const Value *val)
+{
+	const Thunk *thk = val->data.thunk;
+	int i;
+
+	for (i = 0; i < kp; i++) {
+		if (konts[i].kind == C_Update && konts[i].thunk == thk) {
+			abandon();
+			fwprintf(stderr, L"<<loop>>\n");
+			fail();
+		}
+	}
+
+	gc_park();
+	for (i = 0; LOAD_PTR(&thk->value) == 0 && LOAD_PTR(&thk->exp) == 0;
+	     i++) {
+		if (speculating && (i > AWAIT_LIMIT
+		    || LOAD_INT(&par_quiescing))) {
+			gc_unpark();
+			abandon();
+		}
+		par_pause(i);
+	}
+	gc_unpark();
+
+	return val;
+}
+
+
+/* speculate - forces a thunk on a worker thread, or gives up; returns
+   true if the thunk was evaluated */
+
+bool speculate(const Value *val)
+{
+	jmp_buf here;
+	int     roots = gc_protected();
+
+	if (setjmp(here) != 0) {
+		gc_unprotect(gc_protected() - roots);
+		speculating = false;
+		return false;
+	}
+
+	abandoned   = &here;
+	speculating = true;
+	force(val);
+	speculating = false;
+
+	return true;
+}
+
+
+/* unwind - empties the continuation stack, returning every thunk
+   under evaluation to its unevaluated state */
+
+static void unwind(void)
+{
+	Thunk *thk = 0;
+
+	nested = 0;
+	while (kp > 0) {
+		--kp;
+		if (konts[kp].kind == C_Update) {
+			thk = konts[kp].thunk;
+			thk->env = konts[kp].env;
+			STORE_PTR(&thk->exp, konts[kp].exp);
+		}
+	}
+}
+
+
+/* abandon - gives up a speculative evaluation; does nothing on the
+   main thread */
+
+void abandon(void)
+{
+	if (!speculating) {
+		return;
+	}
+
+	unwind();
+	longjmp(*abandoned, 1);
+}
+
+
+/* fail - gives up the current job or statement after an error, or
+   exits */
+
+void fail(void)
+{
+	abandon();
+	if (failed == 0) {
+		exit(EXIT_FAILURE);
+	}
+
+	unwind();
+	vm_unwind();
+	longjmp(*failed, 1);
+}
+
+
+/* eval - evaluate an expression */
+
+const Value *eval(const Exp * exp, Env * env)
+{
+	assert(exp != 0);
+	assert(env != 0);
+
+	return run(exp, env, 0);
+}
+
+
 /* apply - apply a function to an argument */
 
 const Value *apply(const Function *fun, const Value *arg)
@@ -142,31 +845,243 @@ const Value *apply(const Function *fun, const Value *arg)
 }
 
 
+/* call - apply a value to an argument */
+
+const Value *call(const Value *op, const Value *arg)
+{
+	const Function *fn = 0;
+
+	gc_protect(&arg);
+	op = force(op);
+	if (op->type == T_Num) {
+		op = church_value(op->data.num);
+	}
+	fn = (Function *) the(T_Function, op);
+	gc_unprotect(1);
+	STAT_APPLY(fn);
+
+	return fn->apply(fn, arg);
+}
+
+
+/* church_value - the Church encoding of a native number */
+
+const Value *church_value(Number n)
+{
+	const Exp *exp = church_exp(n);
+
+	return make_function(exp->child[0], exp->child[1],
+		get_global_environment());
+}
+
+
+/* cheap - tests whether an argument is as cheap to evaluate as to
+   promise */
+
+bool cheap(const Exp *exp)
+{
+	switch (exp->type) {
+	case T_Exp_Local:
+	case T_Exp_Quote:
+	case T_Exp_Num:
+	case T_Exp_Lambda:
+		return true;
+	default:
+		return false;
+	}
+}
+
+
+/* argument - evaluates a cheap argument, or promises to evaluate it */
+
+static const Value *argument(const Exp *exp, Env *env)
+{
+	if (!cheap(exp)) {
+		return promise(exp, env);
+	}
+
+	STAT(++counts.avoided);
+
+	switch (exp->type) {
+	case T_Exp_Local:
+		return lookup_local(exp->nval, env);
+	case T_Exp_Quote:
+		return make_exp_value(exp->child[0]);
+	case T_Exp_Num:
+		return make_num_value(exp->num);
+	default:
+		return make_function(exp->child[0], exp->child[1], env);
+	}
+}
+
+
 /* promise - delayed evaluation */
 
 const Value *promise(const Exp *exp, Env *env)
 {
-	return make_thunk(exp, env);
+	const Value *val = make_thunk(exp, env);
+
+	STAT(++counts.promised);
+	if (par_sparking && exp->type == T_Exp_Pair) {
+		par_spark(val);
+	}
+
+	return val;
 }
 
 
-/* force - force a delayed evaluation */
+/* compress - follows a chain of evaluated thunks to its end, and
+   points every thunk on the chain at the end */
 
-const Value *force(const Value *val)
+const Value *compress(const Value *val)
 {
+	const Value *end = val;
 	Thunk *thk = 0;
 
-	assert(val != 0);
-	while (val->type == T_Thunk) {
+	while (end->type == T_Thunk && LOAD_PTR(&end->data.thunk->value) != 0) {
+		end = LOAD_PTR(&end->data.thunk->value);
+	}
+	while (val != end) {
 		thk = val->data.thunk;
-		if (thk->value == 0) {
-			thk->value = eval(thk->exp, thk->env);
+		val = LOAD_PTR(&thk->value);
+		if (val != end) {
+			STORE_PTR(&thk->value, end);
+			STAT(++counts.compressed);
 		}
-		val = thk->value;
-		assert(val != 0);
 	}
 
-	return val;
+	return end;
+}
+
+
+/* by_address - orders values by address */
+
+static int by_address(const void *a, const void *b)
+{
+	uintptr_t x = (uintptr_t)*(const Value * const *)a;
+	uintptr_t y = (uintptr_t)*(const Value * const *)b;
+
+	return x < y ? -1 : x > y ? 1 : 0;
+}
+
+
+/* frozen_thunk - adds an unevaluated thunk to those of freeze() */
+
+static void frozen_thunk(const void *obj, int kind, size_t sz)
+{
+	const Value *val = obj;
+
+	(void)sz;
+	if (kind != K_Value || val->type != T_Thunk
+	    || val->data.thunk->value != 0) {
+		return;
+	}
+	if (nfrozen == sfrozen) {
+		sfrozen = sfrozen > 0 ? 2 * sfrozen : 256;
+		frozen = realloc(frozen, sfrozen * sizeof(*frozen));
+		assert(frozen != 0);
+	}
+	frozen[nfrozen++] = val;
+}
+
+
+/* freeze - makes the thunks of the prelude that are not evaluated yet
+   read-only, so that no job evaluates one in its own context for the
+   others; see thaw() */
+
+static void freeze(void)
+{
+	gc_collect();
+	arena_walk(frozen_thunk);
+	qsort(frozen, nfrozen, sizeof(*frozen), by_address);
+}
+
+
+/* copy_slot - finds the slot of a frozen thunk in the copies of the
+   job, growing them as needed */
+
+static Copy *copy_slot(const Value *val)
+{
+	Copy *old = copies;
+	int   n = scopies, i;
+
+	if (2 * (ncopies + 1) > scopies) {
+		scopies = scopies > 0 ? 2 * scopies : 64;
+		copies = calloc(scopies, sizeof(*copies));
+		assert(copies != 0);
+		for (i = 0; i < n; i++) {
+			if (old[i].thunk != 0) {
+				*copy_slot(old[i].thunk) = old[i];
+			}
+		}
+		free(old);
+	}
+	i = ((uintptr_t)val >> 4) & (scopies - 1);
+	while (copies[i].thunk != 0 && copies[i].thunk != val) {
+		i = (i + 1) & (scopies - 1);
+	}
+
+	return &copies[i];
+}
+
+
+/* thaw - returns the job's copy of a frozen thunk, made on first use,
+   or the value itself if it is not frozen */
+
+static const Value *thaw(const Value *val)
+{
+	const Thunk *thk = 0;
+	Copy  *c = 0;
+	Value *copy = 0;
+
+	if (val->type != T_Thunk
+	    || bsearch(&val, frozen, nfrozen, sizeof(*frozen), by_address)
+	       == 0) {
+		return val;
+	}
+	c = copy_slot(val);
+	if (c->thunk == 0) {
+		thk = val->data.thunk;
+		copy = (Value *)make_thunk(thk->exp, thk->env);
+		copy->data.thunk->code = thk->code;
+		c->thunk = val;
+		c->copy  = copy;
+		++ncopies;
+	}
+
+	return c->copy;
+}
+
+
+/* blackhole - marks a thunk as under evaluation */
+
+void blackhole(Thunk *thk)
+{
+	assert(thk->value == 0);
+
+	if (thk->exp == 0) {
+		fwprintf(stderr, L"<<loop>>\n");
+		fail();
+	}
+
+	thk->exp  = 0;
+	thk->env  = 0;
+	thk->code = 0;
+}
+
+
+/* force - force a delayed evaluation */
+
+const Value *force(const Value *val)
+{
+	assert(val != 0);
+
+	if (val->type == T_Thunk) {
+		val = compress(val);
+		STAT(val->type != T_Thunk && ++counts.cached);
+	}
+
+	return val->type == T_Thunk ? run(0, 0, val) : val;
 }
 
 
@@ -175,40 +1090,75 @@ const Value *force(const Value *val)
 static const Value *make_function(const Exp *param, const Exp *body,
 				  Env *env)
 {
-	Function *fn = 0;
-	Object obj;
+	Value    *val = 0;
+	Function *fn  = 0;
 
 	assert(param->type == T_Exp_Symbol);
 
-	fn = (Function *)mymalloc(sizeof(*fn));
+	val = alloc_value(T_Function);
+	fn  = val->data.function;
 	fn->name  = 0;
 	fn->param = param;
 	fn->body  = body;
 	fn->env   = env;
 	fn->apply = apply;
+	fn->code  = 0;
 
-	obj.function = fn;
-
-	return make_value(obj, T_Function);
+	return val;
 }
 
 
 /* make_builtin - makes a builtin function object */
 
-static const Value *make_builtin(const wchar_t *name, Procedure proc)
+const Value *make_builtin(const wchar_t *name, Procedure proc)
 {
-	Function *fn = 0;
+	Value    *val = 0;
+	Function *fn  = 0;
 
-	fn = (Function *)mymalloc(sizeof(fn));
-	fn->name    = _wcsdup(name);
+	val = alloc_value(T_Function);
+	fn  = val->data.function;
+	fn->name    = intern(name);
 	fn->param   = 0;
 	fn->body    = 0;
 	fn->env     = 0;
 	fn->apply   = proc;
+	fn->code    = 0;
+
+	return val;
+}
+
+
+/* builtin_name - returns the name of the procedure of a builtin, or 0
+   if proc is not one */
 
-	return make_function_value(fn);
+const wchar_t *builtin_name(Procedure proc)
+{
+	int i;
+
+	for (i = 0; builtins[i].name != 0; i++) {
+		if (builtins[i].proc == proc) {
+			break;
+		}
+	}
+
+	return builtins[i].name;
+}
+
+
+/* builtin_procedure - returns the procedure of a builtin, or 0 */
+
+Procedure builtin_procedure(const wchar_t *name)
+{
+	int i;
+
+	for (i = 0; builtins[i].name != 0; i++) {
+		if (wcscmp(builtins[i].name, name) == 0) {
+			break;
+		}
+	}
+
+	return builtins[i].proc;
 }
-                                 
 
 
 /* make_value - makes a value */
@@ -217,23 +1167,36 @@ const Value *make_value(Object data, Type type)
 {
 	Value *val = 0;
 
-	val = (Value *)mymalloc(sizeof(*val));
+	val = (Value *)gc_alloc(K_Value, sizeof(*val));
 	val->type = type;
 	val->data = data;
+	if (heap_profiling) {
+		heap_note(val, sizeof(*val));
+	}
 
 	return val;
 }
 
 
-/* make_function_value - makes a function value */
+/* alloc_value - allocates a function or thunk value, with its
+   Function or Thunk in the same object */
 
-const Value *make_function_value(Function *fn)
+Value *alloc_value(Type type)
 {
-	Object obj;
+	Value  *val = 0;
+	size_t  sz  = sizeof(*val);
 
-	obj.function = fn;
-	
-	return make_value(obj, T_Function);
+	assert(type == T_Function || type == T_Thunk);
+
+	sz += type == T_Function ? sizeof(Function) : sizeof(Thunk);
+	val = (Value *)gc_alloc(K_Value, sz);
+	val->type     = type;
+	val->data.und = val + 1;
+	if (heap_profiling) {
+		heap_note(val, sz);
+	}
+
+	return val;
 }
 
 
@@ -249,15 +1212,22 @@ const Value *make_exp_value(const Exp *exp)
 }
 
 
-/* make_thunk_value - makes a thunk value */
+/* make_num_value - makes a native number value */
 
-const Value *make_thunk_value(Thunk *thk)
+const Value *make_num_value(Number n)
 {
 	Object obj;
 
-	obj.thunk = thk;
+	obj.num = n;
+
+	if (n < NUM_SMALL) {
+		if (small[n] == 0) {
+			small[n] = make_value(obj, T_Num);
+		}
+		return small[n];
+	}
 
-	return make_value(obj, T_Thunk);
+	return make_value(obj, T_Num);
 }
 
 
@@ -265,14 +1235,17 @@ const Value *make_thunk_value(Thunk *thk)
 
 static const Value *make_thunk(const Exp *exp, Env *env)
 {
+	Value *val = 0;
 	Thunk *thk = 0;
 
-	thk = (Thunk *)mymalloc(sizeof(*thk));
+	val = alloc_value(T_Thunk);
+	thk = val->data.thunk;
 	thk->value = 0;
 	thk->exp   = exp;
 	thk->env   = env;
+	thk->code  = 0;
 
-	return make_thunk_value(thk);
+	return val;
 }
 
 
@@ -281,7 +1254,9 @@ static const Value *make_thunk(const Exp *exp, Env *env)
 void print_thunk(const Thunk *thk, FILE *stream)
 {
 	fwprintf(stream, L"#<Thunk@%p value=%p, exp=", thk, thk->value);
-	print_exp(thk->exp, stream);
+	if (thk->exp != 0) {
+		print_exp(thk->exp, stream);
+	}
 	fwprintf(stream, L">\n");
 }
 
@@ -290,66 +1265,500 @@ void print_thunk(const Thunk *thk, FILE *stream)
 
 const Value *print(const Function *fun, const Value *arg)
 {
-	print_value(force(arg), stdout);
-	fputwc(newline, stdout);
+	abandon();
+	gc_protect(&arg);
+	print_value(force(arg), output);
+	fputwc(newline, output);
+	gc_unprotect(1);
 	return arg;
 }
 
 
-/* load - load a source file */
+/* load_stream - evaluates the statements of a stream; returns the
+   number read */
+
+static unsigned int load_stream(FILE *in)
+{
+	Reader *rd = reader_open(in);
+	const Exp *exp = 0;
+	unsigned int nlines = 0;
+
+	gc_protect(&exp);
+	par_quiesce();
+	while ((exp = read_statement(rd)) != 0) {
+		++nlines;
+		exp = resolve(exp);
+		execute(exp, get_global_environment());
+		par_quiesce();
+	}
+	gc_unprotect(1);
+	reader_close(rd);
+
+	return nlines;
+}
+
+
+/* open_source - opens a source file by its wide name */
+
+static FILE *open_source(const wchar_t *filename)
+{
+	FILE *in = 0;
+#if defined(_WIN32)
+	if (_wfopen_s(&in, filename, L"r") != 0) {
+		in = 0;
+	}
+#else
+	char name[FILENAME_MAX + 1];
+
+	if (wcstombs(name, filename, sizeof(name)) < sizeof(name)) {
+		in = fopen(name, "r");
+	}
+#endif
+
+	return in;
+}
+
+
+/* load - load a source file, or what has changed in it since it was
+   last loaded (see module(3)) */
 
 const Value *load(const Function *fun, const Value *arg)
 {
 	const wchar_t *basename;
 	wchar_t filename[FILENAME_MAX + 1];
 	FILE *in;
-	const Exp *exp;
-	Env *gbl;
-	unsigned int nlines = 0;
+	int nread = 0, nrun = 0;
+	int stmt = 0;			/* of the heap profile */
+	double start = 0;		/* of the trace */
 
+	abandon();
 	arg = force(arg);
 	assert(arg->type == T_Exp);
 	basename = arg->data.exp->sval;
-	swprintf(filename, FILENAME_MAX, L"%s.l", basename);
-	_wfopen_s(&in, filename, L"r");
-	gbl = get_global_environment();
-	
-	while (!feof(in)) {
-		if ((exp = read_statement(in)) != 0) {
-			++nlines;
-			eval(exp, gbl);
-		}
+	swprintf(filename, FILENAME_MAX, L"%ls.l", basename);
+	if ((in = open_source(filename)) == 0) {
+		fwprintf(stderr, L"%s: cannot open ", "load");
+		fputws(filename, stderr);
+		fputwc(L'\n', stderr);
+		fail();
+	}
+
+	if (heap_profiling) {
+		stmt = heap_current();
+	}
+	if (tracing) {
+		start = trace_now();
+	}
+	nrun = module_load(filename, in, execute, &nread);
+	if (heap_profiling) {
+		heap_resume(stmt);
+	}
+	if (tracing) {
+		trace_span(TR_Load, basename, 0, start);
 	}
 
 	fclose(in);
 
-	fwprintf(stderr, L";; %d lines read\n", nlines);
+	fwprintf(stderr, L";; %d lines read, %d evaluated\n", nread, nrun);
 
-	return make_exp_value(make_symbol_exp(L"ok"));
+	return make_exp_value(make_symbol_exp(intern(L"ok")));
 }
 
 
-/* main - program entry */
+/* show_stats - report the runtime counters, and return the argument */
 
-int main(int argc, char *argv[])
+const Value *show_stats(const Function *fun, const Value *arg)
+{
+	abandon();
+	stats_report(stderr);
+	return arg;
+}
+
+
+/* show_heap - report the heap profile, and return the argument */
+
+const Value *show_heap(const Function *fun, const Value *arg)
+{
+	abandon();
+	gc_protect(&arg);
+	heap_report(stderr);
+	gc_unprotect(1);
+	return arg;
+}
+
+
+/* execute - evaluate a statement with the selected engine */
+
+static const Value *execute(const Exp *exp, Env *env)
+{
+	if (use_inet && exp->type == T_Exp_Assign) {
+		inet_define(exp);
+	}
+	if (heap_profiling) {
+		heap_statement(exp);
+	}
+
+	return use_vm ? vm_eval(exp, env) : eval(exp, env);
+}
+
+
+/* repl - evaluates the statements of a stream and prints their
+   values; echoes each statement on stderr if echo is set. Outside
+   of a job, a statement that fails is given up, and the next one is
+   read */
+
+static void repl(Reader *rd, FILE *out, bool echo)
 {
 	Env *gbl = get_global_environment();
-	
-	bind(L"print", make_builtin(L"print", print), gbl);
-	bind(L"load",  make_builtin(L"load",  load),  gbl);
+	const Exp *exp = 0;
+	jmp_buf here;
+	bool recover = failed == 0;
+	double start = 0;		/* of the trace */
+	volatile int n = 0;
+	int roots;
+
+	gc_protect(&exp);
+	roots = gc_protected();
+	if (recover) {
+		failed = &here;
+	}
 
-	while (!feof(stdin)) {
-		const Exp *exp = 0;
-		if ((exp = read_statement(stdin)) != 0) {
+	for (;;) {
+		if (recover) {
+			if (setjmp(here) != 0) {
+				gc_unprotect(gc_protected() - roots);
+				norm_reset();
+				par_quiesce();
+				continue;
+			}
+		}
+		if ((exp = read_statement(rd)) == 0) {
+			break;
+		}
+		exp = resolve(exp);
+		++n;
+		if (tracing) {
+			start = trace_now();
+		}
+		if (echo) {
 			fputws(L";; ", stderr);
 			print_exp(exp, stderr);
 			fputwc(L'\n', stderr);
 			fflush(stderr);
-			print_value(force(eval(exp, gbl)), stdout);
-			fputwc(L'\n', stdout);
-			fflush(stdout);
 		}
+		if (use_inet && exp->type != T_Exp_Assign) {
+			print_exp(inet_normalize(exp), out);
+		} else if (normal_form && exp->type != T_Exp_Assign) {
+			print_exp(normalize(execute(exp, gbl)), out);
+		} else {
+			print_value(force(execute(exp, gbl)), out);
+		}
+		fputwc(L'\n', out);
+		fflush(out);
+		par_quiesce();
+		if (tracing) {
+			trace_span(TR_Statement, exp->type == T_Exp_Assign
+				? exp->child[0]->sval : 0, n, start);
+		}
+	}
+
+	if (recover) {
+		failed = 0;
+	}
+	gc_unprotect(1);
+}
+
+
+/* output_name - names the output file of a job: the name of its
+   source file, less .l, with .out appended */
+
+static void output_name(const char *src, char *name, size_t size)
+{
+	size_t len = strlen(src);
+
+	if (len > 2 && strcmp(src + len - 2, ".l") == 0) {
+		len -= 2;
+	}
+	snprintf(name, size, "%.*s.out", (int)len, src);
+}
+
+
+/* job_failed - reports a job that failed */
+
+static void job_failed(long i)
+{
+	long n;
+
+	fwprintf(stderr, L";; %s: failed\n", jobs[i]);
+	do {
+		n = LOAD_INT(&nfailed);
+	} while (!CAS_INT(&nfailed, n, n + 1));
+}
+
+
+/* run_job - evaluates a source file of the batch in a global context
+   of its own, writing its values to its output file */
+
+static void run_job(long i)
+{
+	char     name[FILENAME_MAX + 1];
+	jmp_buf  here;
+	Globals *g = 0;
+	Module  *m = 0;
+	FILE    *in = 0, *out = 0;
+	Reader  *rd = 0;
+	int      roots = gc_protected();
+	bool     ok;
+
+	output_name(jobs[i], name, sizeof(name));
+	if ((in = fopen(jobs[i], "r")) == 0
+	    || (out = fopen(name, "w")) == 0) {
+		fwprintf(stderr, L"%s: cannot open %s\n", "run_job",
+			in == 0 ? jobs[i] : name);
+		if (in != 0) {
+			fclose(in);
+		}
+		job_failed(i);
+		return;
+	}
+
+	g = new_globals();
+	use_globals(g);
+	m = use_modules(0);
+	output = out;
+	failed = &here;
+	rd = reader_open(in);
+
+	if (setjmp(here) == 0) {
+		repl(rd, out, false);
+		ok = true;
+	} else {
+		gc_unprotect(gc_protected() - roots);
+		norm_reset();
+		ok = false;
+	}
+
+	failed = 0;
+	output = stdout;
+	free(copies);
+	copies  = 0;
+	ncopies = 0;
+	scopies = 0;
+	use_globals(0);
+	free_globals(g);
+	free_modules(use_modules(m));
+	reader_close(rd);
+	fclose(in);
+	fclose(out);
+	if (!ok) {
+		job_failed(i);
+	}
+}
+
+
+/* wall_clock - returns the time in seconds since some fixed point */
+
+static double wall_clock(void)
+{
+#if defined(_WIN32)
+	LARGE_INTEGER now, freq;
+
+	QueryPerformanceCounter(&now);
+	QueryPerformanceFrequency(&freq);
+	return (double)now.QuadPart / freq.QuadPart;
+#else
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+#endif
+}
+
+
+/* main - program entry */
+
+int main(int argc, char *argv[])
+{
+	double start = wall_clock();
+	Env *gbl = get_global_environment();
+	bool alloc_stats = false;
+	bool show_counts = false;	/* --stats */
+	bool heap_profile = false;	/* --heap-profile */
+	const char *prelude = 0;
+	const char *image = 0;		/* --image */
+	const char *dump = 0;		/* --dump-image */
+	const char *profile = 0;	/* --profile */
+	const char *trace = 0;		/* --trace */
+	FILE *in = 0;
+	Reader *rd = 0;
+	int nthreads = 0;
+	int njobs = 0;			/* -j: jobs at a time */
+	int nfiles = 0;
+	int i;
+
+	jobs = (const char **)calloc(argc, sizeof(*jobs));
+	assert(jobs != 0);
+
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--alloc-stats") == 0) {
+			alloc_stats = true;
+			read_stats = true;
+		} else if (strcmp(argv[i], "--stats") == 0) {
+			show_counts = true;
+		} else if (strcmp(argv[i], "--heap-profile") == 0) {
+			heap_profile = true;
+		} else if (strcmp(argv[i], "--gc-stats") == 0) {
+			gc_verbose = true;
+		} else if (strcmp(argv[i], "--vm") == 0) {
+			use_vm = true;
+		} else if (strcmp(argv[i], "--normalize") == 0) {
+			normal_form = true;
+		} else if (strcmp(argv[i], "--inet") == 0) {
+			use_inet = true;
+		} else if (strcmp(argv[i], "--steps") == 0 && i + 1 < argc) {
+			norm_budget = atol(argv[++i]);
+		} else if (strcmp(argv[i], "--hash-cons") == 0) {
+			exp_hash_cons = true;
+		} else if (strcmp(argv[i], "--max-depth") == 0 && i + 1 < argc) {
+			max_depth = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--par") == 0 && i + 1 < argc) {
+			nthreads = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+			njobs = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--prelude") == 0 && i + 1 < argc) {
+			prelude = argv[++i];
+		} else if (strcmp(argv[i], "--image") == 0 && i + 1 < argc) {
+			image = argv[++i];
+		} else if (strcmp(argv[i], "--dump-image") == 0
+			   && i + 1 < argc) {
+			dump = argv[++i];
+		} else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+			profile = argv[++i];
+		} else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+			trace = argv[++i];
+		} else if (strcmp(argv[i], "--trace-min") == 0
+			   && i + 1 < argc) {
+			trace_min = atof(argv[++i]);
+		} else if (argv[i][0] != '-') {
+			jobs[nfiles++] = argv[i];
+		} else {
+			fwprintf(stderr, L"usage: %s [--alloc-stats] [--gc-stats]"
+				L" [--stats] [--vm] [--hash-cons] [--max-depth n]"
+				L" [--normalize] [--inet] [--steps n] [--par n]"
+				L" [--prelude file] [--image file]"
+				L" [--dump-image file] [--profile file]"
+				L" [--heap-profile] [--trace file]"
+				L" [--trace-min us] [-j n] [file ...]\n",
+				argv[0]);
+			exit(EXIT_FAILURE);
+		}
+	}
+	if (nthreads < 0 || nthreads >= PAR_MAX_THREADS
+	    || (nthreads > 0 && (use_vm || exp_hash_cons))) {
+		fwprintf(stderr, L"%s: --par takes 0 to %d threads, and does"
+			L" not combine with --vm or --hash-cons\n", argv[0],
+			PAR_MAX_THREADS - 1);
+		exit(EXIT_FAILURE);
+	}
+	if (njobs < 0 || njobs > PAR_MAX_THREADS
+	    || (njobs > 0 && nfiles == 0)
+	    || (nfiles > 0 && (nthreads > 0 || use_vm || exp_hash_cons
+				|| use_inet))) {
+		fwprintf(stderr, L"%s: -j takes 1 to %d jobs and source files,"
+			L" which do not combine with --par, --vm, --hash-cons"
+			L" or --inet\n", argv[0], PAR_MAX_THREADS);
+		exit(EXIT_FAILURE);
+	}
+	if ((profile != 0 || heap_profile || trace != 0)
+	    && (use_vm || nthreads > 0 || nfiles > 0)) {
+		fwprintf(stderr, L"%s: --profile, --heap-profile and --trace"
+			L" do not combine with --vm, --par or source files\n",
+			argv[0]);
+		exit(EXIT_FAILURE);
+	}
+	if (image != 0 && use_inet) {
+		fwprintf(stderr, L"%s: --image does not combine with --inet\n",
+			argv[0]);
+		exit(EXIT_FAILURE);
+	}
+	if (nfiles > 0) {
+		par_batch(njobs > 0 ? njobs : 1);
+	} else {
+		par_start(nthreads);
+	}
+	output = stdout;
+	if (profile != 0) {
+		profile_start(profile);
+	}
+	if (heap_profile) {
+		heap_start();
+	}
+	if (trace != 0) {
+		trace_start(trace);
+	}
+	
+	for (i = 0; builtins[i].name != 0; i++) {
+		if (builtins[i].global) {
+			bind(intern(builtins[i].name),
+				make_builtin(builtins[i].name, builtins[i].proc),
+				gbl);
+		}
+	}
+	numeral[0]  = make_local_exp(intern(L"succ"), 0);
+	numeral[1]  = make_num_exp(0);
+	numeral_env = link(intern(L"succ"), make_builtin(L"succ", num_succ),
+		0);
+
+	if (image != 0) {
+		image_load(image);
+	}
+	if (prelude != 0) {
+		if ((in = fopen(prelude, "r")) == 0) {
+			fwprintf(stderr, L"%s: cannot open %s\n", argv[0],
+				prelude);
+			exit(EXIT_FAILURE);
+		}
+		load_stream(in);
+		fclose(in);
+	}
+
+	if (nfiles > 0) {
+		freeze();
+		par_run(nfiles, run_job);
+		fwprintf(stderr, L";; %d jobs, %ld failed\n", nfiles,
+			nfailed);
+	} else {
+		rd = reader_open(stdin);
+		repl(rd, stdout, true);
+		reader_close(rd);
+	}
+	if (dump != 0) {
+		par_quiesce();
+		image_dump(dump);
+	}
+
+	if (alloc_stats) {
+		exp_report(stderr);
+		if (use_inet) {
+			inet_report(stderr);
+		}
+		if (par_sparking) {
+			par_report(stderr);
+		}
+		arena_report(stderr);
+		symbol_report(stderr);
+		read_report(stderr);
+		fwprintf(stderr, L";; %.3f s elapsed\n", wall_clock() - start);
+	}
+	if (gc_verbose) {
+		gc_report(stderr);
+	}
+	if (show_counts) {
+		stats_report(stderr);
+	}
+	if (heap_profile) {
+		heap_report(stderr);
 	}
 	
-	return 0;
+	return nfailed > 0 ? EXIT_FAILURE : 0;
 }
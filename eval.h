@@ -1,15 +1,38 @@
 #ifndef _EVAL_H_INCLUDED_
 #define _EVAL_H_INCLUDED_
 
+#include <stdio.h>
+
 #include "types.h"
+#include "par.h"
+
+#define EVAL_MAX_DEPTH	(10 * 1000 * 1000)	/* default max_depth */
+#define EVAL_MAX_NESTING (4 * 1000)		/* runs nested in C */
+
+extern int max_depth;
+
 
 const Value *eval(const Exp *exp, Env *env);
 const Value *apply(const Function *fn, const Value *arg);
 const Value *force(const Value *val);
+const Value *compress(const Value *val);
 const Value *make_value(Object data, Type type);
-const Value *make_function_value(Function *fn);
 const Value *make_exp_value(const Exp *exp);
-const Value *make_thunk_value(Thunk *thk);
+Value	    *alloc_value(Type type);
+const Value *make_num_value(Number n);
+const Value *make_builtin(const wchar_t *name, Procedure proc);
+const wchar_t *builtin_name(Procedure proc);
+Procedure    builtin_procedure(const wchar_t *name);
+const Value *call(const Value *op, const Value *arg);
+const Value *church_value(Number n);
+void	     scan_eval(void);
+bool	     cheap(const Exp *exp);
+void	     blackhole(Thunk *thk);
+void	     eval_attach(void);
+bool	     speculate(const Value *val);
+void	     abandon(void);
+void	     fail(void);
+void	    *the(Type type, const Value *val);
 
 #endif
 
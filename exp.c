@@ -7,7 +7,7 @@
 /*	#include <exp.h>
 /*
 /*	const Exp     *make_symbol_exp(name);
-/*	const wchar_t *name;
+/*	Symbol         name;
 /*
 /*	const Exp     *make_lambda_exp(param, body);
 /*	const Exp     *param;
@@ -23,110 +23,390 @@
 /*	const Exp     *make_assign_exp(lhs, rhs);
 /*	const Exp     *lhs;
 /*	const Exp     *rhs;
+/*
+/*	const Exp     *make_local_exp(name, depth);
+/*	Symbol         name;
+/*	int            depth;
+/*
+/*	const Exp     *make_global_exp(name, slot);
+/*	Symbol         name;
+/*	int            slot;
+/*
+/*	int            exp_arity(exp);
+/*	const Exp     *exp;
+/*
+/*	unsigned int   exp_hash(exp);
+/*	const Exp     *exp;
+/*
+/*	bool           exp_equal(a, b);
+/*	const Exp     *a;
+/*	const Exp     *b;
+/*
+/*	bool           exp_hash_cons;
+/*
+/*	void           sweep_exp(void);
+/*
+/*	void           exp_report(stream);
+/*	FILE          *stream;
+/* DESCRIPTION
+/*	The make_*_exp() functions allocate expressions. An expression
+/*	is allocated with only the fields its type uses, so a number
+/*	or a symbol takes 16 bytes and a pair 24, and expressions of a
+/*	size are laid out next to each other by the arena (see
+/*	arena(3)). The name of a symbol, the number of a number and the
+/*	children of a compound expression share storage: sval is only
+/*	valid for symbols and lexical references, num only for numbers,
+/*	and child[] only for the exp_arity() children of the others.
+/*
+/*	exp_arity() returns the number of children of an expression.
+/*
+/*	When exp_hash_cons is set, the make_*_exp() functions hash-cons:
+/*	a new expression that is structurally identical to a live one
+/*	is not allocated, and the live one is returned instead. Two
+/*	hash-consed expressions are then equal if and only if they are
+/*	the same object. Expressions differing only in the names of
+/*	bound variables are not shared, because names are printed. The
+/*	REPL sets exp_hash_cons with the --hash-cons option.
+/*
+/*	exp_hash() returns a hash of an expression, computed in
+/*	constant time from its fields and the addresses of its children.
+/*	It does not change during the life of the expression, and
+/*	structurally identical hash-consed expressions, being the same
+/*	object, have the same hash.
+/*
+/*	exp_equal() tests two expressions for structural equality. It
+/*	takes constant time for hash-consed expressions.
+/*
+/*	The table of hash-consed expressions does not keep them alive.
+/*	sweep_exp() drops the expressions that the collector did not
+/*	mark; gc_collect() calls it before sweeping. exp_report() writes
+/*	the number of expressions shared to stream.
 /*--*/
 
 
-#include "mystdlib.h"
+#include <assert.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#include "arena.h"
+#include "gc.h"
 #include "types.h"
+#include "exp.h"
+#include "heap.h"
 
 
-/* make_symbol_exp - */
+ /* static data */
 
-const Exp *make_symbol_exp(const wchar_t *name)
+bool exp_hash_cons = false;
+
+static const Exp **table  = 0;		/* hash-consed expressions */
+static int         nslots = 0;		/* a power of 2 */
+static int         nused  = 0;
+
+static unsigned long nshared = 0;	/* allocations avoided */
+
+
+ /* function prototypes */
+
+static int exp_arity_of(Exp_Type type);
+static const Exp *make_exp(Exp_Type type, Number nval, const void *a,
+			   const void *b);
+
+
+/* has_name - tests whether a type of expression has a name */
+
+static bool has_name(Exp_Type type)
 {
-	Exp *exp = 0;
+	return type == T_Exp_Symbol || type == T_Exp_Local
+		|| type == T_Exp_Global;
+}
 
-	exp = (Exp *)mymalloc(sizeof(*exp));
-	exp->type = T_Exp_Symbol;
-	exp->sval = _wcsdup(name);
 
-	return exp;
+/* exp_arity_of - the number of children of a type of expression */
+
+static int exp_arity_of(Exp_Type type)
+{
+	switch (type) {
+	case T_Exp_Lambda:
+	case T_Exp_Pair:
+	case T_Exp_Assign:
+	case T_Exp_Seq:
+		return 2;
+	case T_Exp_Quote:
+		return 1;
+	default:
+		return 0;
+	}
 }
 
 
-/* make_lambda_exp - makes a lambda expression */
+/* exp_arity - the number of children of an expression */
 
-const Exp *make_lambda_exp(const Exp *param, const Exp *body)
+int exp_arity(const Exp *exp)
 {
-	Exp *exp = 0;
+	return exp_arity_of(exp->type);
+}
 
-	exp = (Exp *)mymalloc(sizeof(*exp));
-	exp->type = T_Exp_Lambda;
-	exp->child[0] = param;
-	exp->child[1] = body;
 
-	return exp;
+/* scalar - the number, or the depth or slot, of an expression */
+
+static Number scalar(const Exp *exp)
+{
+	return exp->type == T_Exp_Num ? exp->num : (Number)exp->nval;
 }
 
 
-/* make_pair - makes a pair expression */
+/* hash_fields - hashes the fields of an expression */
 
-const Exp *make_pair_exp(const Exp *op, const Exp *operand)
+static unsigned int hash_fields(Exp_Type type, Number nval, const void *a,
+				const void *b)
 {
-	Exp *exp = 0;
+	unsigned int h = 2166136261u;
 
-	exp = (Exp *)mymalloc(sizeof(*exp));
-	exp->type = T_Exp_Pair;
-	exp->child[0] = op;
-	exp->child[1] = operand;
+	h = (h ^ (unsigned int)type) * 16777619u;
+	h = (h ^ (unsigned int)nval) * 16777619u;
+	h = (h ^ (unsigned int)(nval >> 32)) * 16777619u;
+	h = (h ^ (unsigned int)((size_t)a >> 3)) * 16777619u;
+	h = (h ^ (unsigned int)((size_t)b >> 3)) * 16777619u;
 
-	return exp;
+	return h;
 }
 
 
-/* make_quote - makes a quote expression */
+/* field - the first or second pointer field of an expression */
 
-const Exp *make_quote_exp(const Exp *body)
+static const void *field(const Exp *exp, int i)
 {
-	Exp *exp = 0;
+	if (has_name(exp->type)) {
+		return i == 0 ? exp->sval : 0;
+	}
 
-	exp = (Exp *) mymalloc(sizeof *exp);
-	exp->type = T_Exp_Quote;
-	exp->child[0] = body;
+	return i < exp_arity(exp) ? exp->child[i] : 0;
+}
 
-	return exp;
+
+/* exp_hash - hashes an expression */
+
+unsigned int exp_hash(const Exp *exp)
+{
+	return hash_fields(exp->type, scalar(exp), field(exp, 0),
+		field(exp, 1));
 }
 
 
-/* make_assign - makes an assignment expression */
+/* exp_equal - tests two expressions for structural equality */
 
-const Exp *make_assign_exp(const Exp *key, const Exp *value)
+bool exp_equal(const Exp *a, const Exp *b)
 {
-	Exp *exp = 0;
+	int i;
+
+	if (a == b) {
+		return true;
+	}
+	if (exp_hash_cons || a->type != b->type
+	    || scalar(a) != scalar(b)) {
+		return false;
+	}
+	if (has_name(a->type)) {
+		return a->sval == b->sval;
+	}
+	for (i = 0; i < exp_arity(a); i++) {
+		if (!exp_equal(a->child[i], b->child[i])) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/* find - returns the table entry of an expression */
 
-	exp = (Exp *) mymalloc(sizeof(*exp));
-	exp->type = T_Exp_Assign;
-	exp->child[0] = key;
-	exp->child[1] = value;
+static const Exp **find(Exp_Type type, Number nval, const void *a,
+			const void *b)
+{
+	unsigned int i, mask = nslots - 1;
+	const Exp *exp = 0;
+
+	for (i = hash_fields(type, nval, a, b) & mask; table[i] != 0;
+	     i = (i + 1) & mask) {
+		exp = table[i];
+		if (exp->type == type && scalar(exp) == nval
+		    && field(exp, 0) == a && field(exp, 1) == b) {
+			break;
+		}
+	}
+
+	return &table[i];
+}
+
+
+/* rehash - rebuilds the table with room for n entries, keeping the
+   entries for which keep() is true */
+
+static void rehash(int n, bool (*keep)(const void *))
+{
+	const Exp **old = table;
+	const Exp  *exp = 0;
+	int i, size = nslots;
+
+	while (nslots < 2 * n) {
+		nslots = nslots != 0 ? 2 * nslots : 1024;
+	}
+	table = calloc(nslots, sizeof(*table));
+	assert(table != 0);
+	nused = 0;
+
+	for (i = 0; i < size; i++) {
+		if ((exp = old[i]) != 0 && (keep == 0 || keep(exp))) {
+			*find(exp->type, scalar(exp), field(exp, 0),
+				field(exp, 1)) = exp;
+			++nused;
+		}
+	}
+	free(old);
+}
+
+
+/* sweep_exp - drops the unmarked expressions from the table */
+
+void sweep_exp(void)
+{
+	if (table != 0) {
+		rehash(nused, arena_marked);
+	}
+}
+
+
+/* make_exp - makes an expression, or finds an identical one */
+
+static const Exp *make_exp(Exp_Type type, Number nval, const void *a,
+			   const void *b)
+{
+	Exp *exp = 0;
+	const Exp **entry = 0;
+	size_t sz = offsetof(Exp, child);
+
+	if (exp_hash_cons) {
+		if (2 * (nused + 1) > nslots) {
+			rehash(nused + 1, 0);
+		}
+		if (*(entry = find(type, nval, a, b)) != 0) {
+			++nshared;
+			return *entry;
+		}
+	}
+
+	if (has_name(type)) {
+		sz += sizeof(exp->sval);
+	} else if (type == T_Exp_Num) {
+		sz += sizeof(exp->num);
+	} else {
+		sz += exp_arity_of(type) * sizeof(exp->child[0]);
+	}
+
+	exp = (Exp *)gc_alloc(K_Exp, sz);
+	exp->type = type;
+	exp->nval = type == T_Exp_Num ? 0 : (int)nval;
+	if (has_name(type)) {
+		exp->sval = a;
+	} else if (type == T_Exp_Num) {
+		exp->num = nval;
+	} else if (exp_arity_of(type) > 0) {
+		exp->child[0] = a;
+		if (exp_arity_of(type) > 1) {
+			exp->child[1] = b;
+		}
+	}
+	if (heap_profiling) {
+		heap_note(exp, sz);
+	}
+
+	if (entry != 0) {
+		*entry = exp;
+		++nused;
+	}
 
 	return exp;
 }
 
 
+/* make_symbol_exp - makes a symbol expression */
+
+const Exp *make_symbol_exp(Symbol name)
+{
+	return make_exp(T_Exp_Symbol, 0, name, 0);
+}
+
+
+/* make_lambda_exp - makes a lambda expression */
+
+const Exp *make_lambda_exp(const Exp *param, const Exp *body)
+{
+	return make_exp(T_Exp_Lambda, 0, param, body);
+}
+
+
+/* make_pair - makes a pair expression */
+
+const Exp *make_pair_exp(const Exp *op, const Exp *operand)
+{
+	return make_exp(T_Exp_Pair, 0, op, operand);
+}
+
+
+/* make_quote - makes a quote expression */
+
+const Exp *make_quote_exp(const Exp *body)
+{
+	return make_exp(T_Exp_Quote, 0, body, 0);
+}
+
+
+/* make_assign - makes an assignment expression */
+
+const Exp *make_assign_exp(const Exp *key, const Exp *value)
+{
+	return make_exp(T_Exp_Assign, 0, key, value);
+}
+
+
 /* make_seq - makes a sequencing expression */
 
 const Exp *make_seq_exp(const Exp *head, const Exp *tail)
 {
-	Exp *exp = 0;
+	return make_exp(T_Exp_Seq, 0, head, tail);
+}
 
-	exp = (Exp *) mymalloc(sizeof(*exp));
-	exp->type = T_Exp_Seq;
-	exp->child[0] = head;
-	exp->child[1] = tail;
 
-	return exp;
+/* make_num_exp - makes a numeric expression */
+
+const Exp *make_num_exp(Number nval)
+{
+	return make_exp(T_Exp_Num, nval, 0, 0);
 }
 
 
-/* make_num_exp - makes a numeric expression */
+/* make_local_exp - makes a reference to a lambda parameter */
 
-const Exp *make_num_exp(unsigned int nval)
+const Exp *make_local_exp(Symbol name, int depth)
 {
-	Exp *exp = 0;
+	return make_exp(T_Exp_Local, depth, name, 0);
+}
 
-	exp = (Exp *) mymalloc(sizeof(*exp));
-	exp->type = T_Exp_Num;
-	exp->nval = nval;
 
-	return exp;
+/* make_global_exp - makes a reference to a global slot */
+
+const Exp *make_global_exp(Symbol name, int slot)
+{
+	return make_exp(T_Exp_Global, slot, name, 0);
+}
+
+
+/* exp_report - reports hash-consing totals */
+
+void exp_report(FILE *stream)
+{
+	fwprintf(stream, L";; %lu expressions shared, %d in table\n",
+		nshared, nused);
 }
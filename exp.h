@@ -1,12 +1,26 @@
 #ifndef _EXP_H_INCLUDED_
 #define _EXP_H_INCLUDED_
 
+#include <stdio.h>
+
+#include "types.h"
+
+extern bool exp_hash_cons;
+
+
 const Exp *make_lambda_exp(const Exp *, const Exp *);
 const Exp *make_pair_exp(const Exp *, const Exp *);
 const Exp *make_quote_exp(const Exp *);
 const Exp *make_assign_exp(const Exp *, const Exp *);
-const Exp *make_symbol_exp(const wchar_t *);
+const Exp *make_symbol_exp(Symbol);
 const Exp *make_seq_exp(const Exp *, const Exp *);
-const Exp *make_num_exp(unsigned int);
+const Exp *make_num_exp(Number);
+const Exp *make_local_exp(Symbol, int);
+const Exp *make_global_exp(Symbol, int);
+int        exp_arity(const Exp *);
+unsigned int exp_hash(const Exp *);
+bool       exp_equal(const Exp *, const Exp *);
+void       sweep_exp(void);
+void       exp_report(FILE *);
 
 #endif
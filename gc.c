@@ -0,0 +1,408 @@
+/*++
+/* NAME
+/*	gc 3
+/* SUMMARY
+/*	Mark-sweep garbage collector.
+/* SYNOPSIS
+/*	#include <gc.h>
+/*
+/*	void	*gc_alloc(kind, sz);
+/*	Kind	kind;
+/*	size_t	sz;
+/*
+/*	void	gc_protect(addr);
+/*	const void *addr;
+/*
+/*	void	gc_unprotect(n);
+/*	int	n;
+/*
+/*	void	gc_poll();
+/*
+/*	void	gc_collect();
+/*
+/*	void	gc_mark(obj);
+/*	const void *obj;
+/*
+/*	void	gc_report(stream);
+/*	FILE	*stream;
+/*
+/*	int	gc_protected();
+/*
+/*	void	gc_attach();
+/*
+/*	void	gc_park();
+/*
+/*	void	gc_unpark();
+/* DESCRIPTION
+/*	This module implements a precise mark-sweep collector for the
+/*	objects of the evaluator. Every collected object is allocated by
+/*	gc_alloc(), which takes a kind from enum Kind so the collector
+/*	knows how to trace it, and a size in bytes.
+/*
+/*	The roots are the global environment, the continuation stack of
+/*	the evaluator (see eval(3)), the stacks of the virtual machine
+/*	(see vm(3)), and every local variable registered with
+/*	gc_protect(). gc_protect() takes the address of a pointer
+/*	variable; the variable is traced at its current value until a
+/*	matching gc_unprotect() call releases the last n registered
+/*	variables. The evaluator registers the registers of its machine,
+/*	and the REPL registers the current statement.
+/*
+/*	gc_alloc() never collects. Once the bytes allocated since the
+/*	last collection exceed the heap threshold, it asks for a
+/*	collection, which is carried out by the next call to gc_poll().
+/*	The evaluator polls before each expression it evaluates, when
+/*	all live objects are reachable from the roots. The threshold is
+/*	the larger of GC_MIN_HEAP and the number of bytes that survived
+/*	the last collection.
+/*
+/*	With the --par and -j options (see par(3) and eval(3)) every
+/*	thread has roots and an allocation count of its own, which it
+/*	registers with gc_attach(), and asks for a collection once it
+/*	has allocated the threshold itself. The thread that polls first
+/*	then waits until every other thread is waiting in gc_poll() too,
+/*	or is parked, and collects. gc_park() tells the collector not to
+/*	wait for the calling thread, which promises not to touch the
+/*	heap until it calls gc_unpark(); threads park while they wait
+/*	for each other. gc_unpark() waits for a collection under way to
+/*	finish. gc_poll() also gives up a speculative evaluation when
+/*	par_quiesce() is called. gc_protected() returns the number of
+/*	registered variables.
+/*
+/*	gc_collect() collects immediately. gc_mark() marks an object
+/*	and, eventually, all objects reachable from it. It is used by
+/*	the modules that define private object types.
+/*
+/*	When gc_verbose is set, each collection reports its pause time
+/*	and the number of bytes reclaimed on the standard error stream.
+/*	gc_report() writes totals to stream.
+/* DIAGNOSTICS
+/*	Memory allocation errors are fatal errors.
+/*--*/
+
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "types.h"
+#include "arena.h"
+#include "env.h"
+#include "eval.h"
+#include "exp.h"
+#include "vm.h"
+#include "num.h"
+#include "norm.h"
+#include "inet.h"
+#include "par.h"
+#include "stats.h"
+#include "gc.h"
+
+
+ /* structure definitions */
+
+typedef struct Stack Stack;
+
+struct Stack {
+	const void **base;
+	int          depth;
+	int          size;
+};
+
+
+ /* static data */
+
+bool gc_verbose = false;
+
+static THREAD_LOCAL Stack  roots = { 0, 0, 0 };	/* addresses of protected
+						   variables */
+static Stack  marks = { 0, 0, 0 };	/* objects marked but not scanned */
+
+static long   requested   = 0;		/* collect at next poll */
+static THREAD_LOCAL size_t allocated = 0;	/* bytes allocated since
+						   last gc */
+static size_t threshold   = GC_MIN_HEAP;
+
+static Stack  *all_roots[PAR_MAX_THREADS];	/* see gc_attach() */
+static size_t *all_allocated[PAR_MAX_THREADS];
+
+static Mutex  world    = MUTEX_INITIALIZER;	/* guards the following */
+static Cond   changed  = COND_INITIALIZER;
+static int    running  = 1;		/* threads that are not parked */
+static bool   stopping = false;		/* a thread waits to collect */
+
+static unsigned long ncollections = 0;
+static unsigned long nreclaimed   = 0;
+static clock_t       paused       = 0;
+
+
+/* push - pushes a pointer on a stack */
+
+static void push(Stack *stk, const void *ptr)
+{
+	if (stk->depth == stk->size) {
+		stk->size = stk->size != 0 ? stk->size * 2 : 1024;
+		stk->base = realloc(stk->base, stk->size * sizeof(*stk->base));
+		assert(stk->base != 0);
+	}
+	stk->base[stk->depth++] = ptr;
+}
+
+
+/* gc_alloc - allocates a collected object */
+
+void *gc_alloc(Kind kind, size_t sz)
+{
+	allocated += sz;
+	STAT(counts.bytes += sz);
+	if (allocated > threshold) {
+		STORE_INT(&requested, 1);
+	}
+
+	return arena_alloc(sz, kind);
+}
+
+
+/* gc_protect - registers a local variable as a root */
+
+void gc_protect(const void *addr)
+{
+	push(&roots, addr);
+}
+
+
+/* gc_unprotect - releases the last n registered variables */
+
+void gc_unprotect(int n)
+{
+	assert(n <= roots.depth);
+	roots.depth -= n;
+}
+
+
+/* gc_protected - returns the number of registered variables */
+
+int gc_protected(void)
+{
+	return roots.depth;
+}
+
+
+/* gc_attach - registers the roots of the calling thread */
+
+void gc_attach(void)
+{
+	all_roots[par_self()]     = &roots;
+	all_allocated[par_self()] = &allocated;
+}
+
+
+/* gc_park - lets collections go ahead without the calling thread */
+
+void gc_park(void)
+{
+	par_lock(&world);
+	--running;
+	par_broadcast(&changed);
+	par_unlock(&world);
+}
+
+
+/* gc_unpark - waits for a collection under way to finish, then lets
+   the next one wait for the calling thread */
+
+void gc_unpark(void)
+{
+	par_lock(&world);
+	while (stopping) {
+		par_wait(&changed, &world);
+	}
+	++running;
+	par_unlock(&world);
+}
+
+
+/* gc_mark - marks an object */
+
+void gc_mark(const void *obj)
+{
+	if (obj != 0 && arena_mark(obj)) {
+		push(&marks, obj);
+	}
+}
+
+
+/* scan_value - marks the objects a value refers to */
+
+static void scan_value(const Value *val)
+{
+	const Function *fn  = 0;
+	const Thunk    *thk = 0;
+
+	switch (val->type) {
+	case T_Function:
+		fn = val->data.function;
+		gc_mark(fn->param);
+		gc_mark(fn->body);
+		gc_mark(fn->env);
+		gc_mark(fn->code);
+		break;
+
+	case T_Thunk:
+		thk = val->data.thunk;
+		gc_mark(thk->value);
+		gc_mark(thk->exp);
+		gc_mark(thk->env);
+		gc_mark(thk->code);
+		break;
+
+	case T_Num:
+		break;
+
+	default:
+		gc_mark(val->data.und);
+		break;
+	}
+}
+
+
+/* scan - marks the children of an object */
+
+static void scan(const void *obj)
+{
+	const Exp      *exp = 0;
+	int             i;
+
+	switch (arena_kind(obj)) {
+	case K_Exp:
+		exp = (const Exp *)obj;
+		for (i = 0; i < exp_arity(exp); i++) {
+			gc_mark(exp->child[i]);
+		}
+		break;
+
+	case K_Value:
+		scan_value((const Value *)obj);
+		break;
+
+	case K_Env:
+		scan_env((const Env *)obj);
+		break;
+
+	case K_Binding:
+		scan_binding((const Binding *)obj);
+		break;
+
+	case K_Code:
+		scan_code((const Code *)obj);
+		break;
+
+	default:
+		fwprintf(stderr, L"%s: %d: %s: Unknown object kind: %d\n",
+			__FILE__, __LINE__, "scan", arena_kind(obj));
+		exit(EXIT_FAILURE);
+	}
+}
+
+
+/* gc_collect - collects garbage */
+
+void gc_collect(void)
+{
+	clock_t start = clock(), pause = 0;
+	size_t  freed = 0;
+	Stack  *stk = 0;
+	int     i, j;
+
+	gc_mark(get_global_environment());
+	scan_eval();
+	scan_vm();
+	scan_num();
+	scan_norm();
+	scan_inet();
+	for (j = 0; j <= par_threads; j++) {
+		stk = all_roots[j];
+		for (i = 0; i < stk->depth; i++) {
+			gc_mark(*(const void * const *)stk->base[i]);
+		}
+	}
+	while (marks.depth > 0) {
+		scan(marks.base[--marks.depth]);
+	}
+
+	sweep_exp();
+	sweep_par();
+	freed = arena_sweep();
+
+	for (j = 0; j <= par_threads; j++) {
+		*all_allocated[j] = 0;
+	}
+	STORE_INT(&requested, 0);
+	threshold = arena_live() > GC_MIN_HEAP ? arena_live() : GC_MIN_HEAP;
+
+	pause = clock() - start;
+	paused += pause;
+	nreclaimed += freed;
+	++ncollections;
+
+	if (gc_verbose) {
+		fwprintf(stderr, L";; gc: %lu bytes reclaimed, %lu live,"
+			L" %.3f ms\n", (unsigned long)freed,
+			(unsigned long)arena_live(),
+			pause * 1000.0 / CLOCKS_PER_SEC);
+	}
+}
+
+
+/* safepoint - collects garbage once every other thread is parked or
+   waiting here, or waits while another thread collects */
+
+static void safepoint(void)
+{
+	if (LOAD_INT(&par_quiescing)) {
+		abandon();
+	}
+	if (par_threads == 0) {
+		gc_collect();
+		return;
+	}
+
+	par_lock(&world);
+	--running;
+	if (stopping) {
+		par_broadcast(&changed);
+		while (stopping) {
+			par_wait(&changed, &world);
+		}
+	} else if (LOAD_INT(&requested)) {
+		stopping = true;
+		while (running > 0) {
+			par_wait(&changed, &world);
+		}
+		gc_collect();
+		stopping = false;
+		par_broadcast(&changed);
+	}
+	++running;
+	par_unlock(&world);
+}
+
+
+/* gc_poll - collects garbage if a collection is due */
+
+void gc_poll(void)
+{
+	if (LOAD_INT(&requested) || LOAD_INT(&par_quiescing)) {
+		safepoint();
+	}
+}
+
+
+/* gc_report - reports collection totals */
+
+void gc_report(FILE *stream)
+{
+	fwprintf(stream, L";; %lu collections, %lu bytes reclaimed,"
+		L" %.3f ms paused\n", ncollections, nreclaimed,
+		paused * 1000.0 / CLOCKS_PER_SEC);
+}
@@ -0,0 +1,51 @@
+#ifndef _GC_H_INCLUDED_
+#define _GC_H_INCLUDED_
+#include <stdio.h>
+#include "types.h"
+/*++
+/* NAME
+/*	gc 3h
+/* SUMMARY
+/*	Garbage collector.
+/* DESCRIPTION
+/* .nf
+
+ /* constants */
+
+#define GC_MIN_HEAP (4 * 1024 * 1024)	/* bytes allocated before first gc */
+
+
+ /* kinds of collected objects */
+
+enum Kind {
+	K_Free,			/* must be ARENA_FREE */
+	K_Exp,
+	K_Value,		/* with its Function or Thunk */
+	K_Env,
+	K_Binding,
+	K_Code
+};
+
+typedef enum Kind Kind;
+
+
+ /* Function prototypes */
+
+void	*gc_alloc(Kind kind, size_t sz);
+void	 gc_protect(const void *addr);
+void	 gc_unprotect(int n);
+int	 gc_protected(void);
+void	 gc_poll(void);
+void	 gc_collect(void);
+void	 gc_mark(const void *obj);
+void	 gc_report(FILE *stream);
+void	 gc_attach(void);
+void	 gc_park(void);
+void	 gc_unpark(void);
+
+extern bool gc_verbose;
+
+/* AUTHOR
+/*	Brent Harp
+/*--*/
+#endif
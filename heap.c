@@ -0,0 +1,342 @@
+/*++
+/* NAME
+/*	heap 3
+/* SUMMARY
+/*	Heap profiler.
+/* SYNOPSIS
+/*	#include <heap.h>
+/*
+/*	void	heap_start();
+/*
+/*	void	heap_note(obj, sz);
+/*	const void *obj;
+/*	size_t	sz;
+/*
+/*	void	heap_note_symbol(sz);
+/*	size_t	sz;
+/*
+/*	void	heap_statement(exp);
+/*	const Exp *exp;
+/*
+/*	int	heap_current();
+/*
+/*	void	heap_resume(stmt);
+/*	int	stmt;
+/*
+/*	void	heap_report(stream);
+/*	FILE	*stream;
+/*
+/*	bool	heap_profiling;
+/* DESCRIPTION
+/*	The heap profiler accounts for the memory of the evaluator by
+/*	category: expressions by their type, values by theirs, with
+/*	functions and thunks apart, environments, bindings, compiled
+/*	code, and the names of symbols. It also charges every allocation
+/*	to the named function being applied (see profile(3)) and to the
+/*	top-level statement being evaluated.
+/*
+/*	heap_start() sets heap_profiling, and keeps the shadow stack of
+/*	profile(3). While heap_profiling is set, the modules that
+/*	allocate call heap_note() with each object they get from
+/*	gc_alloc(), once it is initialized so that its type can be told,
+/*	and the size they asked for; symbol(3) calls heap_note_symbol()
+/*	with the bytes of each new name. Sizes are counted as the arena
+/*	rounds them (see arena_size() in arena(3)).
+/*
+/*	heap_statement() starts charging allocations to a new top-level
+/*	statement, numbered from 1 in the order they are evaluated and
+/*	labelled by the name an assignment defines. A statement is
+/*	charged until the next one starts, so forcing its value is
+/*	charged to it too. heap_current() returns the number of the
+/*	statement being charged, and heap_resume() charges it again, as
+/*	when load has evaluated the statements of a file in the middle
+/*	of another.
+/*
+/*	heap_report() collects garbage, and writes to stream the live
+/*	and the total bytes of every category in use, and the HEAP_TOP
+/*	functions and statements that allocated the most bytes. Live
+/*	bytes are found by walking the arena after the collection
+/*	(see arena_walk()); symbols are never freed.
+/* BUGS
+/*	The shadow stack and the counts belong to the main thread, so
+/*	the profiler works on a single thread only.
+/*--*/
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "types.h"
+#include "arena.h"
+#include "gc.h"
+#include "profile.h"
+#include "heap.h"
+
+
+ /* categories */
+
+enum {
+	H_Exp,				/* plus the Exp_Type */
+	H_Value = H_Exp + T_Exp_Global + 1,	/* plus the Type */
+	H_Env = H_Value + T_Num + 1,
+	H_Binding,
+	H_Code,
+	H_Symbol,
+	H_Other,
+	NCATEGORIES
+};
+
+static const wchar_t *category_names[NCATEGORIES] = {
+	L"symbol expressions", L"lambda expressions", L"applications",
+	L"quotations", L"assignments", L"sequences", L"number expressions",
+	L"local references", L"global references",
+	L"expression values", L"functions", L"thunks", L"environment values",
+	L"numbers",
+	L"environments", L"bindings", L"compiled code", L"symbol names",
+	L"other"
+};
+
+
+ /* structure definitions */
+
+typedef struct Site {
+	Symbol        name;	/* function, or statement label; may be 0 */
+	int           stmt;	/* statement number; -1 for a function,
+				   0 for an unused entry */
+	unsigned long bytes;	/* allocated */
+} Site;
+
+
+ /* static data */
+
+bool heap_profiling = false;
+
+static unsigned long totals[NCATEGORIES];	/* bytes allocated */
+static unsigned long live[NCATEGORIES];		/* see heap_report() */
+
+static Site *functions  = 0;	/* open addressing by name */
+static int   nfunctions = 0;
+static int   sfunctions = 0;	/* a power of 2 */
+
+static Site *statements  = 0;	/* by number, from 1 */
+static int   nstatements = 0;
+static int   sstatements = 0;
+static int   current     = 0;	/* statement being evaluated */
+
+
+/* category - returns the category of an object of the arena */
+
+static int category(const void *obj, int kind)
+{
+	switch (kind) {
+	case K_Exp:
+		return H_Exp + ((const Exp *)obj)->type;
+	case K_Value:
+		return H_Value + ((const Value *)obj)->type;
+	case K_Env:
+		return H_Env;
+	case K_Binding:
+		return H_Binding;
+	case K_Code:
+		return H_Code;
+	default:
+		return H_Other;
+	}
+}
+
+
+/* function - returns the site of a function, adding it if new */
+
+static Site *function(Symbol name)
+{
+	Site *old = functions;
+	int   size = sfunctions, i;
+
+	if (2 * (nfunctions + 1) > sfunctions) {
+		sfunctions = sfunctions != 0 ? 2 * sfunctions : 256;
+		functions  = calloc(sfunctions, sizeof(*functions));
+		assert(functions != 0);
+		nfunctions = 0;
+		for (i = 0; i < size; i++) {
+			if (old[i].stmt != 0) {
+				*function(old[i].name) = old[i];
+			}
+		}
+		free(old);
+	}
+
+	i = (int)(((size_t)name >> 3) & (sfunctions - 1));
+	while (functions[i].stmt != 0 && functions[i].name != name) {
+		i = (i + 1) & (sfunctions - 1);
+	}
+	if (functions[i].stmt == 0) {
+		functions[i].name = name;
+		functions[i].stmt = -1;		/* marks the entry used */
+		++nfunctions;
+	}
+
+	return &functions[i];
+}
+
+
+/* charge - charges bytes to the current function and statement */
+
+static void charge(size_t sz)
+{
+	function(profile_top())->bytes += sz;
+	if (current > 0) {
+		statements[current - 1].bytes += sz;
+	}
+}
+
+
+/* heap_start - starts profiling */
+
+void heap_start(void)
+{
+	profile_keep();
+	heap_profiling = true;
+}
+
+
+/* heap_note - accounts for a new object of the arena */
+
+void heap_note(const void *obj, size_t sz)
+{
+	sz = arena_size(sz);
+	totals[category(obj, arena_kind(obj))] += sz;
+	charge(sz);
+}
+
+
+/* heap_note_symbol - accounts for the name of a new symbol */
+
+void heap_note_symbol(size_t sz)
+{
+	totals[H_Symbol] += sz;
+	live[H_Symbol]   += sz;
+	charge(sz);
+}
+
+
+/* heap_statement - starts charging a new statement */
+
+void heap_statement(const Exp *exp)
+{
+	if (nstatements == sstatements) {
+		sstatements = sstatements != 0 ? 2 * sstatements : 1024;
+		statements  = realloc(statements,
+			sstatements * sizeof(*statements));
+		assert(statements != 0);
+	}
+	statements[nstatements].name = exp->type == T_Exp_Assign
+		? exp->child[0]->sval : 0;
+	statements[nstatements].stmt  = nstatements + 1;
+	statements[nstatements].bytes = 0;
+	current = ++nstatements;
+}
+
+
+/* heap_current - returns the statement being charged */
+
+int heap_current(void)
+{
+	return current;
+}
+
+
+/* heap_resume - charges a statement again */
+
+void heap_resume(int stmt)
+{
+	current = stmt;
+}
+
+
+/* visit - counts a live object */
+
+static void visit(const void *obj, int kind, size_t sz)
+{
+	live[category(obj, kind)] += sz;
+}
+
+
+/* by_bytes - orders sites by bytes allocated, the most first */
+
+static int by_bytes(const void *a, const void *b)
+{
+	unsigned long x = ((const Site *)a)->bytes;
+	unsigned long y = ((const Site *)b)->bytes;
+
+	return x < y ? 1 : x > y ? -1 : 0;
+}
+
+
+/* report_sites - writes the sites that allocated the most */
+
+static void report_sites(FILE *stream, const Site *sites, int n)
+{
+	Site *top = 0;
+	int   i, j;
+
+	top = malloc((n > 0 ? n : 1) * sizeof(*top));
+	assert(top != 0);
+	for (i = j = 0; i < n; i++) {
+		if (sites[i].stmt != 0 && sites[i].bytes > 0) {
+			top[j++] = sites[i];
+		}
+	}
+	qsort(top, j, sizeof(*top), by_bytes);
+
+	for (i = 0; i < j && i < HEAP_TOP; i++) {
+		fwprintf(stream, L";; %12lu  ", top[i].bytes);
+		if (top[i].stmt > 0) {
+			fwprintf(stream, L"statement %d", top[i].stmt);
+			if (top[i].name != 0) {
+				fputws(L", ", stream);
+			}
+		}
+		if (top[i].name != 0) {
+			fputws(top[i].name, stream);
+		} else if (top[i].stmt < 0) {
+			fputws(L"(top level)", stream);
+		}
+		fputwc(L'\n', stream);
+	}
+	free(top);
+}
+
+
+/* heap_report - reports live and total bytes, and the top sites */
+
+void heap_report(FILE *stream)
+{
+	int c;
+
+	if (!heap_profiling) {
+		fwprintf(stream, L";; heap profiling is off\n");
+		return;
+	}
+
+	gc_collect();
+	for (c = 0; c < NCATEGORIES; c++) {
+		if (c != H_Symbol) {
+			live[c] = 0;
+		}
+	}
+	arena_walk(visit);
+
+	fwprintf(stream, L";; %12ls  %12ls  category\n", L"live", L"total");
+	for (c = 0; c < NCATEGORIES; c++) {
+		if (totals[c] == 0 && live[c] == 0) {
+			continue;
+		}
+		fwprintf(stream, L";; %12lu  %12lu  ", live[c], totals[c]);
+		fputws(category_names[c], stream);
+		fputwc(L'\n', stream);
+	}
+	fwprintf(stream, L";; %12ls  top allocating functions\n", L"total");
+	report_sites(stream, functions, sfunctions);
+	fwprintf(stream, L";; %12ls  top allocating statements\n", L"total");
+	report_sites(stream, statements, nstatements);
+}
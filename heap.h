@@ -0,0 +1,33 @@
+#ifndef _HEAP_H_INCLUDED_
+#define _HEAP_H_INCLUDED_
+#include <stdio.h>
+#include "types.h"
+/*++
+/* NAME
+/*	heap 3h
+/* SUMMARY
+/*	Heap profiler.
+/* DESCRIPTION
+/* .nf
+
+ /* constants */
+
+#define HEAP_TOP	(10)		/* functions and statements reported */
+
+
+ /* Function prototypes */
+
+void	 heap_start(void);
+void	 heap_note(const void *obj, size_t sz);
+void	 heap_note_symbol(size_t sz);
+void	 heap_statement(const Exp *exp);
+int	 heap_current(void);
+void	 heap_resume(int stmt);
+void	 heap_report(FILE *stream);
+
+extern bool heap_profiling;
+
+/* AUTHOR
+/*	Brent Harp
+/*--*/
+#endif
@@ -0,0 +1,957 @@
+/*++
+/* NAME
+/*	image 3
+/* SUMMARY
+/*	Images of the global environment.
+/* SYNOPSIS
+/*	#include <image.h>
+/*
+/*	void	image_dump(path);
+/*	const char *path;
+/*
+/*	void	image_load(path);
+/*	const char *path;
+/* DESCRIPTION
+/*	An image is a snapshot of the global environment, which starts a
+/*	later run where this one ends without reading and evaluating its
+/*	source again. It is written with the --dump-image option and read
+/*	with --image (see eval(3)).
+/*
+/*	image_dump() writes the bound slots of the current global context
+/*	to a file, with every object they lead to: the symbols, the
+/*	expressions, the functions with their environments, and the
+/*	thunks. An evaluated thunk is written as the value at the end of
+/*	its chain (see compress() in eval(3)), so what the run has forced
+/*	stays forced. Builtins are written by name. Compiled code is not
+/*	written: the functions and thunks of vm(3) keep their expressions
+/*	and are read back as those of the evaluator.
+/*
+/*	An image is a sequence of 32-bit words in the byte order of the
+/*	machine that wrote it: a header, the symbols, the expressions in
+/*	an order that puts children before their parents, the other
+/*	objects, and the global bindings. A native number takes two
+/*	words, the low one first. Objects refer to one another by
+/*	number, so an image does not depend on where anything was in
+/*	memory.
+/*
+/*	image_load() maps an image into memory where the system allows
+/*	it, and reads it whole otherwise. It does not parse or evaluate
+/*	anything: it interns the symbols, makes the expressions, and
+/*	relocates the numbers of the other objects into pointers as it
+/*	copies them into the collected heap, in two passes, as frames
+/*	and the values bound in them may refer to each other. References
+/*	to global names are given the slots of the names in this run,
+/*	and each global binding of the image replaces the current one.
+/*	The collector does not run while an image is loaded.
+/* DIAGNOSTICS
+/*	Failing to open or write an image, reading a file that is not an
+/*	image, and saving a value that belongs to an evaluation under way,
+/*	such as a thunk under evaluation or a neutral value of norm(3),
+/*	are fatal errors.
+/*--*/
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#if defined(_WIN32)
+#define fileno	_fileno
+#else
+#include <sys/mman.h>
+#endif
+
+#include "types.h"
+#include "arena.h"
+#include "env.h"
+#include "gc.h"
+#include "eval.h"
+#include "exp.h"
+#include "symbol.h"
+#include "vm.h"
+#include "image.h"
+
+
+ /* constants */
+
+#define IMAGE_MAGIC	(0x4c434931u)	/* "LCI1" */
+#define IMAGE_VERSION	(2)
+
+
+ /* structure definitions */
+
+typedef unsigned int Word;
+
+enum Record {			/* kinds of object records */
+	R_Env,			/* link, n, then n names and values */
+	R_Function,		/* name, param, body, env */
+	R_Builtin,		/* procedure name, name, env */
+	R_Thunk,		/* exp, env */
+	R_Quote,		/* exp */
+	R_Num			/* number */
+};
+
+/* References: a symbol or an expression is 0 for none, or its number
+   plus 1. Another object is 0 for none, 1 for the global environment,
+   or its number plus 2. */
+
+#define REF_GLOBAL	(1)
+
+typedef struct Table Table;
+
+struct Table {			/* numbers objects by address */
+	const void  **keys;	/* open-addressing hash table */
+	Word         *nums;
+	size_t        size;	/* a power of 2 */
+	const void  **list;	/* objects by number */
+	size_t        n;
+	size_t        max;
+};
+
+typedef struct Buffer Buffer;
+
+struct Buffer {
+	Word   *words;
+	size_t  n;
+	size_t  size;
+};
+
+typedef struct Image Image;
+
+struct Image {			/* an image being read */
+	const char   *path;
+	const Word   *base;
+	const Word   *p;
+	const Word   *end;
+	Symbol       *syms;
+	Word          nsyms;
+	const Exp   **exps;
+	Word          nexps;
+	const void  **objs;
+	Word         *kinds;	/* enum Record of each object */
+	const Word  **records;	/* where each object's record starts */
+	Word          nobjs;
+};
+
+
+ /* static data */
+
+static Table  syms, exps, objs;		/* of the image being written */
+static Buffer sym_out, exp_out, obj_out, global_out;
+
+static char building;		/* a frame being made */
+
+
+/* hash - hashes an address */
+
+static size_t hash(const void *key)
+{
+	return (size_t)(((size_t)key >> 3) * 2654435761u);
+}
+
+
+/* find - returns the hash table entry of an address */
+
+static size_t find(const Table *t, const void *key)
+{
+	size_t i, mask = t->size - 1;
+
+	for (i = hash(key) & mask; t->keys[i] != 0; i = (i + 1) & mask) {
+		if (t->keys[i] == key) {
+			break;
+		}
+	}
+
+	return i;
+}
+
+
+/* numbered - returns the number of an object plus 1, or 0 if it has
+   none */
+
+static Word numbered(const Table *t, const void *key)
+{
+	size_t i;
+
+	if (t->size == 0 || t->keys[i = find(t, key)] == 0) {
+		return 0;
+	}
+
+	return t->nums[i] + 1;
+}
+
+
+/* number - numbers an object that has no number, and returns its
+   number plus 1 */
+
+static Word number(Table *t, const void *key)
+{
+	const void **keys = t->keys;
+	Word         *nums = t->nums;
+	size_t        i, size = t->size;
+
+	if (2 * (t->n + 1) > t->size) {
+		t->size = size != 0 ? 2 * size : 1024;
+		t->keys = calloc(t->size, sizeof(*t->keys));
+		t->nums = malloc(t->size * sizeof(*t->nums));
+		assert(t->keys != 0 && t->nums != 0);
+		for (i = 0; i < size; i++) {
+			if (keys[i] != 0) {
+				t->keys[find(t, keys[i])] = keys[i];
+				t->nums[find(t, keys[i])] = nums[i];
+			}
+		}
+		free(keys);
+		free(nums);
+	}
+
+	if (t->n == t->max) {
+		t->max = t->max != 0 ? 2 * t->max : 1024;
+		t->list = realloc(t->list, t->max * sizeof(*t->list));
+		assert(t->list != 0);
+	}
+	i = find(t, key);
+	assert(t->keys[i] == 0);
+	t->keys[i] = key;
+	t->nums[i] = (Word)t->n;
+	t->list[t->n] = key;
+
+	return (Word)++t->n;
+}
+
+
+/* emit - appends a word to a buffer */
+
+static void emit(Buffer *buf, Word w)
+{
+	if (buf->n == buf->size) {
+		buf->size = buf->size != 0 ? 2 * buf->size : 4096;
+		buf->words = realloc(buf->words, buf->size * sizeof(Word));
+		assert(buf->words != 0);
+	}
+	buf->words[buf->n++] = w;
+}
+
+
+/* emit_number - appends a native number, in two words */
+
+static void emit_number(Buffer *buf, Number n)
+{
+	emit(buf, (Word)n);
+	emit(buf, (Word)(n >> 32));
+}
+
+
+/* cannot_save - reports a value that cannot be written */
+
+static void cannot_save(const char *what)
+{
+	fwprintf(stderr, L"%s: cannot save %s\n", "image", what);
+	exit(EXIT_FAILURE);
+}
+
+
+/* sym_ref - returns the reference of a symbol, writing it first */
+
+static Word sym_ref(Symbol sym)
+{
+	Word ref;
+	const wchar_t *s;
+
+	if (sym == 0) {
+		return 0;
+	}
+	if ((ref = numbered(&syms, sym)) != 0) {
+		return ref;
+	}
+
+	emit(&sym_out, (Word)wcslen(sym));
+	for (s = sym; *s != 0; s++) {
+		emit(&sym_out, (Word)*s);
+	}
+
+	return number(&syms, sym);
+}
+
+
+/* exp_ref - returns the reference of an expression, writing it after
+   its children, which are numbered first */
+
+static Word exp_ref(const Exp *exp)
+{
+	Word ref, child[2] = { 0, 0 }, name = 0;
+	int  i, arity;
+
+	if (exp == 0) {
+		return 0;
+	}
+	if ((ref = numbered(&exps, exp)) != 0) {
+		return ref;
+	}
+
+	arity = exp_arity(exp);
+	for (i = 0; i < arity; i++) {
+		child[i] = exp_ref(exp->child[i]);
+	}
+	switch (exp->type) {
+	case T_Exp_Symbol:
+	case T_Exp_Local:
+	case T_Exp_Global:
+		name = sym_ref(exp->sval);
+		break;
+	default:
+		break;
+	}
+
+	emit(&exp_out, (Word)exp->type);
+	switch (exp->type) {
+	case T_Exp_Symbol:
+	case T_Exp_Global:
+		emit(&exp_out, name);
+		break;
+	case T_Exp_Local:
+		emit(&exp_out, name);
+		emit(&exp_out, (Word)exp->nval);
+		break;
+	case T_Exp_Num:
+		emit_number(&exp_out, exp->num);
+		break;
+	default:
+		for (i = 0; i < arity; i++) {
+			emit(&exp_out, child[i]);
+		}
+		break;
+	}
+
+	return number(&exps, exp);
+}
+
+
+/* obj_ref - returns the reference of an environment or a value,
+   numbering it to be written */
+
+static Word obj_ref(const void *obj)
+{
+	const Value *val = 0;
+	Word ref;
+
+	if (obj == 0) {
+		return 0;
+	}
+	if (obj == get_global_environment()) {
+		return REF_GLOBAL;
+	}
+	if (arena_kind(obj) == K_Value) {
+		obj = val = compress((const Value *)obj);
+		if (val->type == T_Thunk && val->data.thunk->exp == 0) {
+			cannot_save("a thunk under evaluation");
+		}
+	}
+
+	if ((ref = numbered(&objs, obj)) == 0) {
+		ref = number(&objs, obj);
+	}
+
+	return ref + 1;
+}
+
+
+/* write_env - writes the record of a frame */
+
+static void write_env(const Env *env)
+{
+	const Binding *bnd = 0;
+	const Value   *val = 0;
+	Symbol         name = 0;
+	size_t         count;
+
+	emit(&obj_out, R_Env);
+	emit(&obj_out, obj_ref(env_link(env)));
+	count = obj_out.n;
+	emit(&obj_out, 0);
+	while ((bnd = next_binding(env, bnd, &name, &val)) != 0) {
+		emit(&obj_out, sym_ref(name));
+		emit(&obj_out, obj_ref(val));
+		++obj_out.words[count];
+	}
+}
+
+
+/* write_value - writes the record of a value */
+
+static void write_value(const Value *val)
+{
+	const Function *fn  = 0;
+	const Thunk    *thk = 0;
+	const wchar_t  *builtin = 0;
+
+	switch (val->type) {
+	case T_Function:
+		fn = val->data.function;
+		if (fn->apply == apply || fn->apply == vm_apply) {
+			emit(&obj_out, R_Function);
+			emit(&obj_out, sym_ref(fn->name));
+			emit(&obj_out, exp_ref(fn->param));
+			emit(&obj_out, exp_ref(fn->body));
+		} else if ((builtin = builtin_name(fn->apply)) != 0) {
+			emit(&obj_out, R_Builtin);
+			emit(&obj_out, sym_ref(intern(builtin)));
+			emit(&obj_out, sym_ref(fn->name));
+		} else {
+			cannot_save("a neutral value");
+		}
+		emit(&obj_out, obj_ref(fn->env));
+		break;
+
+	case T_Thunk:
+		thk = val->data.thunk;
+		emit(&obj_out, R_Thunk);
+		emit(&obj_out, exp_ref(thk->exp));
+		emit(&obj_out, obj_ref(thk->env));
+		break;
+
+	case T_Exp:
+		emit(&obj_out, R_Quote);
+		emit(&obj_out, exp_ref(val->data.exp));
+		break;
+
+	case T_Num:
+		emit(&obj_out, R_Num);
+		emit_number(&obj_out, val->data.num);
+		break;
+
+	default:
+		cannot_save("a value of an unknown type");
+	}
+}
+
+
+/* write_buffer - writes a buffer to a stream */
+
+static bool write_buffer(const Buffer *buf, FILE *out)
+{
+	return fwrite(buf->words, sizeof(Word), buf->n, out) == buf->n;
+}
+
+
+/* reset - empties a table and a buffer */
+
+static void reset(Table *t, Buffer *buf)
+{
+	free(t->keys);
+	free(t->nums);
+	free(t->list);
+	memset(t, 0, sizeof(*t));
+	free(buf->words);
+	memset(buf, 0, sizeof(*buf));
+}
+
+
+/* image_dump - writes an image of the global environment */
+
+void image_dump(const char *path)
+{
+	const Value *val = 0;
+	Symbol       name = 0;
+	Word         header[6];
+	FILE        *out = 0;
+	size_t       i;
+	int          slot;
+	bool         ok;
+
+	for (slot = 0; (name = global_binding(slot, &val)) != 0; slot++) {
+		if (val != 0) {
+			emit(&global_out, sym_ref(name));
+			emit(&global_out, obj_ref(val));
+		}
+	}
+
+	/* objects numbered while writing are appended to the list */
+	for (i = 0; i < objs.n; i++) {
+		if (arena_kind(objs.list[i]) == K_Env) {
+			write_env((const Env *)objs.list[i]);
+		} else {
+			write_value((const Value *)objs.list[i]);
+		}
+	}
+
+	header[0] = IMAGE_MAGIC;
+	header[1] = IMAGE_VERSION;
+	header[2] = (Word)syms.n;
+	header[3] = (Word)exps.n;
+	header[4] = (Word)objs.n;
+	header[5] = (Word)(global_out.n / 2);
+
+	if ((out = fopen(path, "wb")) == 0) {
+		fwprintf(stderr, L"%s: cannot open %s\n", "image", path);
+		exit(EXIT_FAILURE);
+	}
+	ok = fwrite(header, sizeof(Word), 6, out) == 6
+		&& write_buffer(&sym_out, out)
+		&& write_buffer(&exp_out, out)
+		&& write_buffer(&obj_out, out)
+		&& write_buffer(&global_out, out);
+	if (fclose(out) != 0 || !ok) {
+		fwprintf(stderr, L"%s: cannot write %s\n", "image", path);
+		exit(EXIT_FAILURE);
+	}
+
+	reset(&syms, &sym_out);
+	reset(&exps, &exp_out);
+	reset(&objs, &obj_out);
+	free(global_out.words);
+	memset(&global_out, 0, sizeof(global_out));
+}
+
+
+/* corrupt - reports an image that cannot be read */
+
+static void corrupt(const Image *img)
+{
+	fwprintf(stderr, L"%s: %s: not an image, or a corrupt one\n",
+		"image", img->path);
+	exit(EXIT_FAILURE);
+}
+
+
+/* word - reads the next word of an image */
+
+static Word word(Image *img)
+{
+	if (img->p == img->end) {
+		corrupt(img);
+	}
+
+	return *img->p++;
+}
+
+
+/* number_at - reads a native number */
+
+static Number number_at(Image *img)
+{
+	Number low = word(img);
+
+	return low | (Number)word(img) << 32;
+}
+
+
+/* sym_at - reads a symbol reference */
+
+static Symbol sym_at(Image *img)
+{
+	Word ref = word(img);
+
+	if (ref > img->nsyms) {
+		corrupt(img);
+	}
+
+	return ref == 0 ? 0 : img->syms[ref - 1];
+}
+
+
+/* exp_at - reads a reference to an expression made already */
+
+static const Exp *exp_at(Image *img, Word made)
+{
+	Word ref = word(img);
+
+	if (ref > made) {
+		corrupt(img);
+	}
+
+	return ref == 0 ? 0 : img->exps[ref - 1];
+}
+
+
+/* read_syms - interns the symbols of an image */
+
+static void read_syms(Image *img)
+{
+	wchar_t *name = 0;
+	Word     i, j, len;
+
+	for (i = 0; i < img->nsyms; i++) {
+		len = word(img);
+		if (len == 0 || len > (Word)(img->end - img->p)) {
+			corrupt(img);
+		}
+		name = realloc(name, (len + 1) * sizeof(*name));
+		assert(name != 0);
+		for (j = 0; j < len; j++) {
+			name[j] = (wchar_t)*img->p++;
+		}
+		name[len] = 0;
+		img->syms[i] = intern(name);
+	}
+
+	free(name);
+}
+
+
+/* read_exps - makes the expressions of an image */
+
+static void read_exps(Image *img)
+{
+	const Exp *a = 0, *b = 0;
+	Symbol     name = 0;
+	Word       i, type;
+
+	for (i = 0; i < img->nexps; i++) {
+		switch (type = word(img)) {
+		case T_Exp_Symbol:
+			if ((name = sym_at(img)) == 0) {
+				corrupt(img);
+			}
+			img->exps[i] = make_symbol_exp(name);
+			break;
+		case T_Exp_Global:
+			if ((name = sym_at(img)) == 0) {
+				corrupt(img);
+			}
+			img->exps[i] = make_global_exp(name, global_slot(name));
+			break;
+		case T_Exp_Local:
+			if ((name = sym_at(img)) == 0) {
+				corrupt(img);
+			}
+			img->exps[i] = make_local_exp(name, (int)word(img));
+			break;
+		case T_Exp_Num:
+			img->exps[i] = make_num_exp(number_at(img));
+			break;
+		case T_Exp_Quote:
+			if ((a = exp_at(img, i)) == 0) {
+				corrupt(img);
+			}
+			img->exps[i] = make_quote_exp(a);
+			break;
+		case T_Exp_Lambda:
+		case T_Exp_Pair:
+		case T_Exp_Assign:
+		case T_Exp_Seq:
+			a = exp_at(img, i);
+			b = exp_at(img, i);
+			if (a == 0 || b == 0) {
+				corrupt(img);
+			}
+			img->exps[i] = type == T_Exp_Lambda ? make_lambda_exp(a, b)
+				: type == T_Exp_Pair ? make_pair_exp(a, b)
+				: type == T_Exp_Assign ? make_assign_exp(a, b)
+				: make_seq_exp(a, b);
+			break;
+		default:
+			corrupt(img);
+		}
+	}
+}
+
+
+/* env_at - reads a reference to an environment */
+
+static Env *env_at(Image *img)
+{
+	Word ref = word(img);
+
+	if (ref == 0) {
+		return 0;
+	}
+	if (ref == REF_GLOBAL) {
+		return get_global_environment();
+	}
+	if (ref - 2 >= img->nobjs || img->kinds[ref - 2] != R_Env) {
+		corrupt(img);
+	}
+
+	return (Env *)img->objs[ref - 2];
+}
+
+
+/* value_at - reads a reference to a value */
+
+static const Value *value_at(Image *img)
+{
+	Word ref = word(img);
+
+	if (ref < 2 || ref - 2 >= img->nobjs || img->kinds[ref - 2] == R_Env) {
+		corrupt(img);
+	}
+
+	return (const Value *)img->objs[ref - 2];
+}
+
+
+/* make_values - makes the values of an image, all but their
+   environments */
+
+static void make_values(Image *img)
+{
+	const Exp *param = 0, *body = 0;
+	Procedure  proc = 0;
+	Symbol     name = 0;
+	Value     *val = 0;
+	Function  *fn  = 0;
+	Thunk     *thk = 0;
+	Word       i, n;
+
+	for (i = 0; i < img->nobjs; i++) {
+		img->records[i] = img->p;
+		switch (img->kinds[i] = word(img)) {
+		case R_Env:
+			word(img);
+			n = word(img);
+			if (n > (Word)(img->end - img->p) / 2) {
+				corrupt(img);
+			}
+			img->p += 2 * n;
+			img->objs[i] = 0;
+			break;
+
+		case R_Function:
+			name  = sym_at(img);
+			param = exp_at(img, img->nexps);
+			body  = exp_at(img, img->nexps);
+			if (param == 0 || param->type != T_Exp_Symbol
+			    || body == 0) {
+				corrupt(img);
+			}
+			val = alloc_value(T_Function);
+			fn  = val->data.function;
+			fn->name  = name;
+			fn->param = param;
+			fn->body  = body;
+			fn->env   = 0;
+			fn->apply = apply;
+			fn->code  = 0;
+			word(img);
+			img->objs[i] = val;
+			break;
+
+		case R_Builtin:
+			if ((name = sym_at(img)) == 0
+			    || (proc = builtin_procedure(name)) == 0) {
+				corrupt(img);
+			}
+			img->objs[i] = val = (Value *)make_builtin(name, proc);
+			val->data.function->name = sym_at(img);
+			word(img);
+			break;
+
+		case R_Thunk:
+			val = alloc_value(T_Thunk);
+			thk = val->data.thunk;
+			thk->value = 0;
+			if ((thk->exp = exp_at(img, img->nexps)) == 0) {
+				corrupt(img);
+			}
+			thk->env  = 0;
+			thk->code = 0;
+			word(img);
+			img->objs[i] = val;
+			break;
+
+		case R_Quote:
+			if ((body = exp_at(img, img->nexps)) == 0) {
+				corrupt(img);
+			}
+			img->objs[i] = make_exp_value(body);
+			break;
+
+		case R_Num:
+			img->objs[i] = make_num_value(number_at(img));
+			break;
+
+		default:
+			corrupt(img);
+		}
+	}
+}
+
+
+/* make_frame - makes the frame of an image record, after its parent */
+
+static void make_frame(Image *img, Word i)
+{
+	Word ref;
+
+	if (img->objs[i] == &building) {
+		corrupt(img);
+	}
+	if (img->objs[i] != 0) {
+		return;
+	}
+
+	img->objs[i] = &building;
+	ref = img->records[i][1];
+	if (ref >= 2 && ref - 2 < img->nobjs && img->kinds[ref - 2] == R_Env) {
+		make_frame(img, ref - 2);
+	}
+	img->p = img->records[i] + 1;
+	img->objs[i] = make_env(env_at(img));
+}
+
+
+/* link_objects - fills in the environments of the values and the
+   bindings of the frames of an image */
+
+static void link_objects(Image *img)
+{
+	const Value **values = 0;
+	Symbol       *names = 0;
+	Value        *val = 0;
+	Word          i, j, n;
+
+	for (i = 0; i < img->nobjs; i++) {
+		if (img->kinds[i] == R_Env) {
+			make_frame(img, i);
+		}
+	}
+
+	for (i = 0; i < img->nobjs; i++) {
+		img->p = img->records[i] + 1;
+		val = (Value *)img->objs[i];
+		switch (img->kinds[i]) {
+		case R_Env:
+			word(img);
+			n = word(img);
+			names  = realloc(names, (n + 1) * sizeof(*names));
+			values = realloc(values, (n + 1) * sizeof(*values));
+			assert(names != 0 && values != 0);
+			for (j = 0; j < n; j++) {
+				if ((names[j] = sym_at(img)) == 0) {
+					corrupt(img);
+				}
+				values[j] = value_at(img);
+			}
+			/* put_binding() adds in front: add the last first */
+			while (n-- > 0) {
+				put_binding((Env *)img->objs[i], names[n],
+					values[n]);
+			}
+			break;
+
+		case R_Function:
+			img->p += 3;
+			val->data.function->env = env_at(img);
+			break;
+
+		case R_Builtin:
+			img->p += 2;
+			val->data.function->env = env_at(img);
+			break;
+
+		case R_Thunk:
+			img->p += 1;
+			val->data.thunk->env = env_at(img);
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	free(names);
+	free(values);
+}
+
+
+/* bind_globals - binds the global names of an image */
+
+static void bind_globals(Image *img, Word n)
+{
+	Symbol name = 0;
+
+	while (n-- > 0) {
+		if ((name = sym_at(img)) == 0) {
+			corrupt(img);
+		}
+		set_global(global_slot(name), value_at(img));
+	}
+}
+
+
+/* image_load - reads an image into the global environment */
+
+void image_load(const char *path)
+{
+	Image   img;
+	Word    nglobals;
+	const Word *globals = 0;
+	FILE   *in = 0;
+	void   *map = 0;
+	size_t  len = 0;
+	struct stat st;
+
+	memset(&img, 0, sizeof(img));
+	img.path = path;
+
+	if ((in = fopen(path, "rb")) == 0 || fstat(fileno(in), &st) != 0) {
+		fwprintf(stderr, L"%s: cannot open %s\n", "image", path);
+		exit(EXIT_FAILURE);
+	}
+	len = (size_t)st.st_size;
+	if (len < 6 * sizeof(Word)) {
+		corrupt(&img);
+	}
+#if !defined(_WIN32)
+	map = mmap(0, len, PROT_READ, MAP_PRIVATE, fileno(in), 0);
+	if (map == MAP_FAILED) {
+		map = 0;
+	}
+#endif
+	if (map != 0) {
+		img.base = map;
+	} else {
+		img.base = malloc(len);
+		assert(img.base != 0);
+		if (fread((void *)img.base, 1, len, in) != len) {
+			corrupt(&img);
+		}
+	}
+	fclose(in);
+
+	img.p   = img.base;
+	img.end = img.base + len / sizeof(Word);
+	if (word(&img) != IMAGE_MAGIC || word(&img) != IMAGE_VERSION) {
+		corrupt(&img);
+	}
+	img.nsyms = word(&img);
+	img.nexps = word(&img);
+	img.nobjs = word(&img);
+	nglobals  = word(&img);
+	if (img.nsyms > len || img.nexps > len || img.nobjs > len) {
+		corrupt(&img);
+	}
+
+	img.syms    = malloc((img.nsyms + 1) * sizeof(*img.syms));
+	img.exps    = malloc((img.nexps + 1) * sizeof(*img.exps));
+	img.objs    = malloc((img.nobjs + 1) * sizeof(*img.objs));
+	img.kinds   = malloc((img.nobjs + 1) * sizeof(*img.kinds));
+	img.records = malloc((img.nobjs + 1) * sizeof(*img.records));
+	assert(img.syms != 0 && img.exps != 0 && img.objs != 0
+		&& img.kinds != 0 && img.records != 0);
+
+	read_syms(&img);
+	read_exps(&img);
+	make_values(&img);
+	if ((size_t)(img.end - img.p) != 2 * (size_t)nglobals) {
+		corrupt(&img);
+	}
+	globals = img.p;
+	link_objects(&img);
+	img.p = globals;
+	bind_globals(&img, nglobals);
+
+#if !defined(_WIN32)
+	if (map != 0) {
+		munmap(map, len);
+	} else
+#endif
+	free((void *)img.base);
+	free(img.syms);
+	free(img.exps);
+	free(img.objs);
+	free(img.kinds);
+	free(img.records);
+}
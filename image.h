@@ -0,0 +1,20 @@
+#ifndef _IMAGE_H_INCLUDED_
+#define _IMAGE_H_INCLUDED_
+#include "types.h"
+/*++
+/* NAME
+/*	image 3h
+/* SUMMARY
+/*	Images of the global environment.
+/* DESCRIPTION
+/* .nf
+
+ /* Function prototypes */
+
+void	 image_dump(const char *path);
+void	 image_load(const char *path);
+
+/* AUTHOR
+/*	Brent Harp
+/*--*/
+#endif
@@ -0,0 +1,916 @@
+/*++
+/* NAME
+/*	inet 3
+/* SUMMARY
+/*	Optimal reduction with interaction nets.
+/* SYNOPSIS
+/*	#include <inet.h>
+/*
+/*	const Exp *inet_normalize(exp);
+/*	const Exp *exp;
+/*
+/*	void	inet_define(exp);
+/*	const Exp *exp;
+/*
+/*	void	scan_inet();
+/*
+/*	void	inet_report(stream);
+/*	FILE	*stream;
+/* DESCRIPTION
+/*	inet_normalize() returns the normal form of a resolved expression
+/*	(see resolve(3)). It translates the expression into an interaction
+/*	net of lambda, application, duplicator and eraser nodes, reduces
+/*	the net and reads the normal form back.
+/*
+/*	Both eval(3) and norm(3) copy the body of a function each time it
+/*	is applied under a lambda, so a term like the exponentiation of
+/*	Church numerals, which applies functions built by applying other
+/*	functions, does the same work over and over. In the net, a shared
+/*	term is copied one node at a time, by duplicators moving through
+/*	it, and only as far as the copies differ. This is the abstract
+/*	algorithm of Lamping without the bracket and croissant nodes of
+/*	his bookkeeping: each duplicator carries a label, and two
+/*	duplicators that meet annihilate when their labels agree and
+/*	copy each other otherwise. That is exact for the terms typable
+/*	in elementary affine logic, which include Church arithmetic. A
+/*	term that makes a duplicator copy another one with the same
+/*	label instead gets the two annihilated, which leaves a net that
+/*	no longer denotes a term. The read-back checks for the signs of
+/*	it: a path that goes round a cycle or ends at a dangling port, a
+/*	variable read outside the body of its lambda, and a duplicator
+/*	passed back through that was never passed through.
+/*
+/*	The net is reduced lazily, in normal order: the read-back asks for
+/*	the head of the subterm it is about to print, and only the
+/*	interactions on the path to that head are done. Terms that have a
+/*	normal form therefore find it, and recursive definitions unfold
+/*	only as far as they are needed.
+/*
+/*	inet_define() records an assignment statement. A reference to a
+/*	recorded name is translated into a reference node, which is
+/*	replaced by a fresh translation of the definition when it meets
+/*	another node, and copied as a whole by a duplicator. Other global
+/*	names, such as the builtins, and quotations are atoms: they read
+/*	back as themselves, and applying them is in normal form. Numbers
+/*	are Church numerals. The first part of a sequence is dropped, so
+/*	no builtin is ever run.
+/*
+/*	Each lambda and each application read back is a step. After
+/*	norm_budget steps (see norm(3)), the remaining subterms read back
+/*	as the symbol `...'. As in norm(3), the normal form may not nest
+/*	deeper than NORM_MAX_DEPTH. The reduction itself may do at most
+/*	INET_WORK interactions and expansions of definitions, and keep
+/*	at most INET_SPACE nodes, per step of norm_budget; 0 lifts these
+/*	limits too.
+/*
+/*	scan_inet() marks the recorded definitions for the garbage
+/*	collector. inet_report() writes the number of interactions to
+/*	stream.
+/* DIAGNOSTICS
+/*	A normal form nested deeper than NORM_MAX_DEPTH, a reduction
+/*	beyond its limits, running out of memory and a malformed net
+/*	are errors (see fail() in eval(3)).
+/* BUGS
+/*	Not every net malformed by duplicators of the same label shows
+/*	a sign the read-back checks for, so a term outside elementary
+/*	affine logic may still read back as a wrong normal form.
+/* SEE ALSO
+/*	J. Lamping, An algorithm for optimal lambda calculus reduction,
+/*	POPL 1990.
+/*--*/
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "types.h"
+#include "gc.h"
+#include "exp.h"
+#include "env.h"
+#include "eval.h"
+#include "symbol.h"
+#include "norm.h"
+#include "inet.h"
+
+
+ /* a port is a node number and a slot; slot 0 is the principal port */
+
+typedef unsigned int Port;
+
+#define PORT(n, s)	((Port)(n) << 2 | (s))
+#define NODE(p)		((int)((p) >> 2))
+#define SLOT(p)		((int)((p) & 3))
+
+
+ /* structure definitions */
+
+typedef struct Node   Node;
+typedef struct Binder Binder;
+typedef struct Fan    Fan;
+typedef struct Task   Task;
+
+enum Node_Kind {
+	I_Free,			/* on the free list */
+	I_Root,			/* slot 1 holds the term */
+	I_Lam,			/* 0 the lambda, 1 its body, 2 its variable */
+	I_App,			/* 0 the function, 1 the argument, 2 the result */
+	I_Dup,			/* 0 the original, 1 and 2 the copies */
+	I_Era,			/* 0 a term to discard */
+	I_Atom,			/* 0 a quotation or a free name */
+	I_Ref			/* 0 a recorded definition */
+};
+
+struct Node {
+	enum Node_Kind kind;
+	unsigned int   label;		/* of a duplicator */
+	int            open;		/* of a lambda: its read-backs under way */
+	union {
+		Symbol     name;	/* of a lambda */
+		const Exp *exp;		/* of an atom */
+		int        slot;	/* of a reference */
+	};
+	Port           port[3];
+};
+
+struct Binder {
+	int   node;			/* the lambda */
+	Port *uses;			/* ports that use its variable */
+	int   nuses;
+	int   maxuses;
+};
+
+struct Fan {
+	unsigned int label;	/* of a duplicator passed through a copy */
+	int          slot;	/* the copy */
+	int          link;	/* index of the previous fan, or -1 */
+};
+
+enum Task_Kind {
+	R_Read,			/* read back the term at port */
+	R_Pair,			/* pair the last two results */
+	R_Lambda		/* make a lambda of name and the last result */
+};
+
+struct Task {
+	enum Task_Kind kind;
+	Port           port;
+	int            fan;
+	Symbol         name;
+	int            depth;	/* R_Read: of the subterm */
+};
+
+
+ /* static data */
+
+static Node  *nodes    = 0;		/* the net */
+static int    nnodes   = 0;
+static int    maxnodes = 0;
+static int    freelist = -1;
+static int    nlive    = 0;
+
+static Port  *spine    = 0;		/* path to the head, see whnf() */
+static int    nspine   = 0;
+static int    maxspine = 0;
+
+static Port  *erased   = 0;		/* active pairs with an eraser */
+static int    nerased  = 0;
+static int    maxerased = 0;
+
+static Binder *binders = 0;		/* lambdas around build() */
+static int    nbinders = 0;
+static int    maxbinders = 0;
+static int    initbinders = 0;		/* binders with a uses stack */
+
+static const Exp **defs = 0;		/* definitions by global slot */
+static int    ndefs    = 0;
+
+static Fan   *fans     = 0;		/* see read_back() */
+static int    nfans    = 0;
+static int    maxfans  = 0;
+static int   *unfans   = 0;
+static int    maxunfans = 0;
+static Task  *tasks    = 0;
+static int    ntasks   = 0;
+static int    maxtasks = 0;
+static const Exp **results = 0;
+static int    nresults = 0;
+static int    maxresults = 0;
+
+static unsigned int  labels = 0;	/* last duplicator label */
+
+static unsigned long ninteractions = 0;
+static unsigned long nexpansions   = 0;
+static int           maxlive       = 0;
+static unsigned long work          = 0;	/* of inet_normalize(), see spend() */
+
+
+ /* function prototypes */
+
+static void build(const Exp *exp, Port port);
+static void malformed(void);
+static void give_up(void);
+
+
+/* grow - makes room for one more element in a stack */
+
+static void *grow(void *base, int n, int *max, size_t size)
+{
+	void *p = 0;
+	int   m = *max != 0 ? 2 * *max : 1024;
+
+	if (n == *max) {
+		if ((p = realloc(base, m * size)) == 0) {
+			fwprintf(stderr, L"%s: out of memory\n", "inet");
+			give_up();
+		}
+		base = p;
+		*max = m;
+	}
+
+	return base;
+}
+
+
+/* new_node - allocates a node */
+
+static int new_node(enum Node_Kind kind)
+{
+	int n;
+
+	if (freelist >= 0) {
+		n = freelist;
+		freelist = (int)nodes[n].port[0];
+	} else {
+		nodes = grow(nodes, nnodes, &maxnodes, sizeof(*nodes));
+		n = nnodes++;
+	}
+
+	nodes[n].kind  = kind;
+	nodes[n].label = 0;
+	nodes[n].open  = 0;
+	nodes[n].exp   = 0;
+
+	if (++nlive > maxlive) {
+		maxlive = nlive;
+	}
+	if (norm_budget > 0 && nlive > INET_SPACE * norm_budget) {
+		fwprintf(stderr, L"%s: net too large: more than %ld nodes\n",
+			"inet", INET_SPACE * norm_budget);
+		give_up();
+	}
+
+	return n;
+}
+
+
+/* free_node - returns a node to the free list */
+
+static void free_node(int n)
+{
+	nodes[n].kind    = I_Free;
+	nodes[n].port[0] = (Port)freelist;
+	freelist = n;
+	--nlive;
+}
+
+
+/* peer - returns the port connected to a port */
+
+static Port peer(Port p)
+{
+	return nodes[NODE(p)].port[SLOT(p)];
+}
+
+
+/* link_ports - connects two ports
+
+   A port of a node that is being replaced may be linked to a new port
+   before it is read with peer(), which then passes the connection on.
+   An active pair with an eraser is remembered, for erase(). */
+
+static void link_ports(Port a, Port b)
+{
+	nodes[NODE(a)].port[SLOT(a)] = b;
+	nodes[NODE(b)].port[SLOT(b)] = a;
+
+	if (SLOT(a) == 0 && SLOT(b) == 0
+	    && (nodes[NODE(a)].kind == I_Era || nodes[NODE(b)].kind == I_Era)) {
+		erased = grow(erased, nerased, &maxerased, sizeof(*erased));
+		erased[nerased++] = a;
+	}
+}
+
+
+/* copy_node - makes a node of the same kind and contents */
+
+static int copy_node(int n)
+{
+	int m = new_node(nodes[n].kind);
+
+	nodes[m] = nodes[n];
+
+	return m;
+}
+
+
+/* erase - discards the active pairs with an eraser, which never loops:
+   each interaction removes a node that is not an eraser, or two that
+   are */
+
+static void erase(void)
+{
+	Port p, q;
+	int e, n, i;
+
+	while (nerased > 0) {
+		p = erased[--nerased];
+		q = peer(p);
+		if (nodes[NODE(p)].kind == I_Free || SLOT(q) != 0
+		    || peer(q) != p) {
+			continue;
+		}
+		e = NODE(p), n = NODE(q);
+		if (nodes[e].kind != I_Era) {
+			e = NODE(q), n = NODE(p);
+		}
+		switch (nodes[n].kind) {
+		case I_Lam:
+		case I_App:
+		case I_Dup:
+			for (i = 1; i <= 2; i++) {
+				link_ports(PORT(new_node(I_Era), 0),
+					peer(PORT(n, i)));
+			}
+			break;
+
+		default:
+			break;
+		}
+		free_node(e);
+		free_node(n);
+		++ninteractions;
+	}
+}
+
+
+/* spend - counts an interaction or an expansion against the budget */
+
+static void spend(void)
+{
+	if (norm_budget > 0 && ++work > (unsigned long)INET_WORK * norm_budget) {
+		fwprintf(stderr, L"%s: reduction too long: more than %ld"
+			L" interactions\n", "inet", INET_WORK * norm_budget);
+		give_up();
+	}
+}
+
+
+/* beta - reduces an application of a lambda */
+
+static void beta(int app, int lam)
+{
+	link_ports(peer(PORT(lam, 1)), peer(PORT(app, 2)));
+	link_ports(peer(PORT(lam, 2)), peer(PORT(app, 1)));
+	free_node(app);
+	free_node(lam);
+}
+
+
+/* annihilate - reduces two duplicators with the same label */
+
+static void annihilate(int a, int b)
+{
+	link_ports(peer(PORT(a, 1)), peer(PORT(b, 1)));
+	link_ports(peer(PORT(a, 2)), peer(PORT(b, 2)));
+	free_node(a);
+	free_node(b);
+}
+
+
+/* commute - lets two nodes pass through each other, each copying the
+   other */
+
+static void commute(int a, int b)
+{
+	int a1 = copy_node(a), a2 = copy_node(a);
+	int b1 = copy_node(b), b2 = copy_node(b);
+
+	link_ports(PORT(a1, 1), PORT(b1, 1));
+	link_ports(PORT(a1, 2), PORT(b2, 1));
+	link_ports(PORT(a2, 1), PORT(b1, 2));
+	link_ports(PORT(a2, 2), PORT(b2, 2));
+
+	link_ports(PORT(b1, 0), peer(PORT(a, 1)));
+	link_ports(PORT(b2, 0), peer(PORT(a, 2)));
+	link_ports(PORT(a1, 0), peer(PORT(b, 1)));
+	link_ports(PORT(a2, 0), peer(PORT(b, 2)));
+
+	free_node(a);
+	free_node(b);
+}
+
+
+/* duplicate - copies an atom or a reference */
+
+static void duplicate(int dup, int n)
+{
+	link_ports(PORT(copy_node(n), 0), peer(PORT(dup, 1)));
+	link_ports(PORT(copy_node(n), 0), peer(PORT(dup, 2)));
+	free_node(dup);
+	free_node(n);
+}
+
+
+/* expand - replaces a reference with its definition */
+
+static void expand(int ref)
+{
+	Port p = peer(PORT(ref, 0));
+	int slot = nodes[ref].slot;
+
+	free_node(ref);
+	build(defs[slot], p);
+	++nexpansions;
+	spend();
+}
+
+
+/* interact - reduces the active pair of the application or duplicator
+   a and the node b. Returns 0 if there is no rule for the pair, 1 if
+   a is gone and 2 if it is still there. */
+
+static int interact(int a, int b)
+{
+	enum Node_Kind ka = nodes[a].kind, kb = nodes[b].kind;
+	int r = 1;
+
+	assert(ka == I_App || ka == I_Dup);
+
+	if (kb == I_Ref && ka == I_App) {
+		expand(b);
+		r = 2;
+	} else if (kb == I_Ref || kb == I_Atom) {
+		if (ka != I_Dup) {
+			return 0;
+		}
+		duplicate(a, b);
+	} else if (ka == I_App && kb == I_Lam) {
+		beta(a, b);
+	} else if (ka == I_Dup && kb == I_Dup
+		   && nodes[a].label == nodes[b].label) {
+		annihilate(a, b);
+	} else if (ka == I_Dup || kb == I_Dup) {
+		commute(a, b);
+	} else {
+		return 0;
+	}
+
+	++ninteractions;
+	spend();
+	erase();
+
+	return r;
+}
+
+
+/* whnf - reduces the term at a port to head normal form
+
+   The spine is the path from the port to the head of the term: each
+   application passes to its function, each copy of a duplicator to
+   the original. The path ends at a lambda, a variable, an atom, or a
+   duplicator entered through its principal port, which the read-back
+   passes through. An active pair on the path is reduced, and the path
+   is taken up again from the node before it. */
+
+static void whnf(Port port)
+{
+	Port p, q;
+	int base = nspine, r;
+
+	spine = grow(spine, nspine, &maxspine, sizeof(*spine));
+	spine[nspine++] = port;
+
+	while (nspine > base) {
+		p = spine[nspine - 1];
+		q = peer(p);
+		if (SLOT(q) == 0) {
+			if (SLOT(p) != 0 || nspine == base + 1) {
+				if (nodes[NODE(q)].kind == I_Ref && SLOT(p) != 0) {
+					expand(NODE(q));
+					continue;
+				}
+				break;
+			}
+			if ((r = interact(NODE(p), NODE(q))) == 0) {
+				break;
+			} else if (r == 1) {
+				--nspine;
+			}
+		} else if (nodes[NODE(q)].kind == I_Lam) {
+			break;
+		} else if ((nodes[NODE(q)].kind != I_App
+			    && nodes[NODE(q)].kind != I_Dup)
+			   || nspine - base > nlive) {
+			malformed();	/* a dangling port, or a cycle */
+		} else {
+			spine = grow(spine, nspine, &maxspine, sizeof(*spine));
+			spine[nspine++] = PORT(NODE(q), 0);
+		}
+	}
+
+	nspine = base;
+}
+
+
+/* bind_variable - connects the variable of the innermost binder to its
+   uses, through duplicators if there is more than one */
+
+static void bind_variable(void)
+{
+	Binder *b = &binders[nbinders - 1];
+	Port var = PORT(b->node, 2);
+	int i, d;
+
+	if (b->nuses == 0) {
+		link_ports(PORT(new_node(I_Era), 0), var);
+	}
+	for (i = 0; i < b->nuses; i++) {
+		b = &binders[nbinders - 1];
+		if (i + 1 < b->nuses) {
+			d = new_node(I_Dup);
+			nodes[d].label = ++labels;
+			link_ports(PORT(d, 0), var);
+			link_ports(PORT(d, 1), b->uses[i]);
+			var = PORT(d, 2);
+		} else {
+			link_ports(var, b->uses[i]);
+		}
+	}
+
+	--nbinders;
+}
+
+
+/* build_church - builds the Church numeral of n at port */
+
+static void build_church(Number n, Port port)
+{
+	int f = new_node(I_Lam), x = new_node(I_Lam), a, d;
+	Port body, var;
+	Number i;
+
+	nodes[f].name = intern(L"f");
+	nodes[x].name = intern(L"x");
+	link_ports(PORT(f, 0), port);
+	link_ports(PORT(x, 0), PORT(f, 1));
+
+	body = PORT(x, 1);
+	var  = PORT(f, 2);
+	for (i = 0; i < n; i++) {
+		a = new_node(I_App);
+		link_ports(PORT(a, 2), body);
+		body = PORT(a, 1);
+		if (i + 1 < n) {
+			d = new_node(I_Dup);
+			nodes[d].label = ++labels;
+			link_ports(PORT(d, 0), var);
+			link_ports(PORT(d, 1), PORT(a, 0));
+			var = PORT(d, 2);
+		} else {
+			link_ports(var, PORT(a, 0));
+		}
+	}
+	if (n == 0) {
+		link_ports(PORT(new_node(I_Era), 0), var);
+	}
+	link_ports(body, PORT(x, 2));
+}
+
+
+/* build - translates an expression into a net whose root is linked to
+   port */
+
+static void build(const Exp *exp, Port port)
+{
+	Binder *b = 0;
+	int n;
+
+	switch (exp->type) {
+	case T_Exp_Lambda:
+		n = new_node(I_Lam);
+		nodes[n].name = exp->child[0]->sval;
+		link_ports(PORT(n, 0), port);
+		binders = grow(binders, nbinders, &maxbinders,
+			sizeof(*binders));
+		if (nbinders == initbinders) {
+			binders[initbinders].uses = 0;
+			binders[initbinders].maxuses = 0;
+			++initbinders;
+		}
+		binders[nbinders].node  = n;
+		binders[nbinders].nuses = 0;
+		++nbinders;
+		build(exp->child[1], PORT(n, 1));
+		bind_variable();
+		break;
+
+	case T_Exp_Pair:
+		n = new_node(I_App);
+		link_ports(PORT(n, 2), port);
+		build(exp->child[0], PORT(n, 0));
+		build(exp->child[1], PORT(n, 1));
+		break;
+
+	case T_Exp_Local:
+		assert(exp->nval < nbinders);
+		b = &binders[nbinders - 1 - exp->nval];
+		b->uses = grow(b->uses, b->nuses, &b->maxuses,
+			sizeof(*b->uses));
+		b->uses[b->nuses++] = port;
+		break;
+
+	case T_Exp_Global:
+		if (exp->nval < ndefs && defs[exp->nval] != 0) {
+			n = new_node(I_Ref);
+			nodes[n].slot = exp->nval;
+		} else {
+			n = new_node(I_Atom);
+			nodes[n].exp = exp;
+		}
+		link_ports(PORT(n, 0), port);
+		break;
+
+	case T_Exp_Num:
+		build_church(exp->num, port);
+		break;
+
+	case T_Exp_Seq:
+	case T_Exp_Assign:
+		build(exp->child[1], port);
+		break;
+
+	default:
+		n = new_node(I_Atom);
+		nodes[n].exp = exp;
+		link_ports(PORT(n, 0), port);
+		break;
+	}
+}
+
+
+/* push_task - pushes a read-back task */
+
+static void push_task(enum Task_Kind kind, Port port, int fan, Symbol name,
+		      int depth)
+{
+	Task *t = 0;
+
+	tasks = grow(tasks, ntasks, &maxtasks, sizeof(*tasks));
+	t = &tasks[ntasks++];
+	t->kind  = kind;
+	t->port  = port;
+	t->fan   = fan;
+	t->name  = name;
+	t->depth = depth;
+}
+
+
+/* push_result - pushes a normal form */
+
+static void push_result(const Exp *exp)
+{
+	results = grow(results, nresults, &maxresults, sizeof(*results));
+	results[nresults++] = exp;
+}
+
+
+/* push_fan - records passing through a copy of a duplicator */
+
+static int push_fan(int fan, unsigned int label, int slot)
+{
+	fans = grow(fans, nfans, &maxfans, sizeof(*fans));
+	fans[nfans].label = label;
+	fans[nfans].slot  = slot;
+	fans[nfans].link  = fan;
+
+	return nfans++;
+}
+
+
+/* pop_fan - finds the copy last passed through of a duplicator with
+   label, and returns the fans without it */
+
+static int pop_fan(int fan, unsigned int label, int *slot)
+{
+	int f, n = 0;
+
+	for (f = fan; f >= 0 && fans[f].label != label; f = fans[f].link) {
+		unfans = grow(unfans, n, &maxunfans, sizeof(*unfans));
+		unfans[n++] = f;
+	}
+	if (f < 0) {
+		malformed();	/* a copy never passed through */
+	}
+
+	*slot = fans[f].slot;
+	for (f = fans[f].link; n > 0; n--) {
+		f = push_fan(f, fans[unfans[n - 1]].label,
+			fans[unfans[n - 1]].slot);
+	}
+
+	return f;
+}
+
+
+/* read_back - reads back the term at the port of the top task */
+
+static void read_back(long *steps)
+{
+	Task t = tasks[--ntasks];
+	const Exp *exp = 0;
+	Port p;
+	int n, slot, hops = 0;
+
+	if (t.depth > NORM_MAX_DEPTH) {
+		fwprintf(stderr, L"%s: normal form too large: deeper than %d\n",
+			"inet", NORM_MAX_DEPTH);
+		give_up();
+	}
+	if (norm_budget > 0 && ++*steps > norm_budget) {
+		push_result(make_symbol_exp(intern(L"...")));
+		return;
+	}
+
+	for (;;) {
+		whnf(t.port);
+		p = peer(t.port);
+		n = NODE(p);
+
+		switch (nodes[n].kind) {
+		case I_Lam:
+			if (SLOT(p) != 0) {
+				if (nodes[n].open == 0) {
+					malformed();	/* out of scope */
+				}
+				push_result(make_symbol_exp(nodes[n].name));
+				return;
+			}
+			nodes[n].name = bind_symbol(nodes[n].name);
+			++nodes[n].open;
+			push_task(R_Lambda, PORT(n, 0), t.fan, nodes[n].name, 0);
+			push_task(R_Read, PORT(n, 1), t.fan, 0, t.depth + 1);
+			return;
+
+		case I_App:
+			push_task(R_Pair, 0, t.fan, 0, 0);
+			push_task(R_Read, PORT(n, 1), t.fan, 0, t.depth + 1);
+			push_task(R_Read, PORT(n, 0), t.fan, 0, t.depth + 1);
+			return;
+
+		case I_Dup:
+			if (++hops > nlive) {
+				malformed();	/* round a cycle */
+			}
+			if (SLOT(p) != 0) {
+				t.fan = push_fan(t.fan, nodes[n].label, SLOT(p));
+				t.port = PORT(n, 0);
+			} else {
+				t.fan = pop_fan(t.fan, nodes[n].label, &slot);
+				t.port = PORT(n, slot);
+			}
+			break;
+
+		case I_Atom:
+			exp = nodes[n].exp;
+			if (exp->type == T_Exp_Global) {
+				exp = make_symbol_exp(exp->sval);
+			}
+			push_result(exp);
+			return;
+
+		default:
+			malformed();
+		}
+	}
+}
+
+
+/* malformed - reports a net that no longer denotes a term */
+
+static void malformed(void)
+{
+	fwprintf(stderr, L"%s: net malformed by duplicators of the same"
+		L" label\n", "inet");
+	give_up();
+}
+
+
+/* give_up - abandons the normalization after an error, unbinding the
+   names of the lambdas being read back */
+
+static void give_up(void)
+{
+	while (ntasks > 0) {
+		if (tasks[--ntasks].kind == R_Lambda) {
+			unbind_symbol(tasks[ntasks].name);
+		}
+	}
+	nspine = 0;
+	fail();
+}
+
+
+/* inet_normalize - returns the normal form of an expression */
+
+const Exp *inet_normalize(const Exp *exp)
+{
+	const Exp *arg = 0;
+	long steps = 0;
+	int root;
+	Task t;
+
+	nnodes = nlive = nerased = nbinders = 0;
+	nfans = ntasks = nresults = nspine = 0;
+	freelist = -1;
+	work = 0;
+
+	root = new_node(I_Root);
+	build(exp, PORT(root, 1));
+	push_task(R_Read, PORT(root, 1), -1, 0, 0);
+
+	while (ntasks > 0) {
+		t = tasks[ntasks - 1];
+		switch (t.kind) {
+		case R_Read:
+			read_back(&steps);
+			break;
+
+		case R_Pair:
+			--ntasks;
+			arg = results[--nresults];
+			exp = results[--nresults];
+			push_result(make_pair_exp(exp, arg));
+			break;
+
+		case R_Lambda:
+			--ntasks;
+			exp = results[--nresults];
+			push_result(make_lambda_exp(make_symbol_exp(t.name), exp));
+			unbind_symbol(t.name);
+			--nodes[NODE(t.port)].open;
+			break;
+		}
+	}
+
+	assert(nresults == 1);
+
+	return results[0];
+}
+
+
+/* inet_define - records an assignment for inet_normalize() */
+
+void inet_define(const Exp *exp)
+{
+	const Exp *name = exp->child[0];
+	int slot, i;
+
+	assert(exp->type == T_Exp_Assign);
+
+	if (name->type != T_Exp_Symbol) {
+		return;
+	}
+
+	slot = global_slot(name->sval);
+	if (slot >= ndefs) {
+		defs = realloc(defs, (slot + 1) * sizeof(*defs));
+		assert(defs != 0);
+		for (i = ndefs; i <= slot; i++) {
+			defs[i] = 0;
+		}
+		ndefs = slot + 1;
+	}
+
+	defs[slot] = exp->child[1];
+}
+
+
+/* scan_inet - marks the recorded definitions */
+
+void scan_inet(void)
+{
+	int i;
+
+	for (i = 0; i < ndefs; i++) {
+		gc_mark(defs[i]);
+	}
+}
+
+
+/* inet_report - reports reduction totals */
+
+void inet_report(FILE *stream)
+{
+	fwprintf(stream, L";; %lu interactions, %lu definitions expanded,"
+		L" %d nodes at most\n", ninteractions, nexpansions, maxlive);
+}
@@ -0,0 +1,29 @@
+#ifndef _INET_H_INCLUDED_
+#define _INET_H_INCLUDED_
+#include <stdio.h>
+#include "types.h"
+/*++
+/* NAME
+/*	inet 3h
+/* SUMMARY
+/*	Optimal reduction with interaction nets.
+/* DESCRIPTION
+/* .nf
+
+ /* constants */
+
+#define INET_WORK  16	/* interactions per step of norm_budget */
+#define INET_SPACE 8	/* live nodes per step of norm_budget */
+
+
+ /* Function prototypes */
+
+const Exp *inet_normalize(const Exp *exp);
+void	   inet_define(const Exp *exp);
+void	   scan_inet(void);
+void	   inet_report(FILE *stream);
+
+/* AUTHOR
+/*	Brent Harp
+/*--*/
+#endif
@@ -0,0 +1,479 @@
+/*++
+/* NAME
+/*	module 3
+/* SUMMARY
+/*	Cache of loaded source files.
+/* SYNOPSIS
+/*	#include <module.h>
+/*
+/*	int	module_load(path, in, run, nread);
+/*	const wchar_t *path;
+/*	FILE	*in;
+/*	Execute	run;
+/*	int	*nread;
+/*
+/*	Module	*use_modules(m);
+/*	Module	*m;
+/*
+/*	void	free_modules(m);
+/*	Module	*m;
+/* DESCRIPTION
+/*	The load builtin of eval(3) evaluates a source file through
+/*	module_load(), which remembers each file it has loaded, so that
+/*	loading it again does only the work its changes call for.
+/*
+/*	module_load() evaluates the statements of the open stream in,
+/*	which has the name path, with run() in the global environment,
+/*	and returns the number evaluated; *nread is set to the number of
+/*	statements in the file. A file loaded before is not read again
+/*	if its size and modification time have not changed since, nor
+/*	evaluated again if its contents hash to the same value as they
+/*	did. A file modified within the second it was last loaded in is
+/*	always hashed, as its modification time may not show the change.
+/*
+/*	When a file has changed, the statements are read and resolved
+/*	(see resolve(3)) first, and each is hashed by its structure, so
+/*	changes to layout and comments do not count. A statement whose
+/*	hash the file did not have before is evaluated again, and so is
+/*	a statement that refers to a name defined by a statement that is
+/*	evaluated again, until no more names change. Other statements
+/*	are not evaluated, and their definitions keep their values.
+/*	Removing a definition from a file does not unbind its name. A
+/*	file that loads another is not checked for changes in the other
+/*	unless its load statement is evaluated again.
+/*
+/*	The list of files loaded belongs to the thread, as the global
+/*	context their definitions are bound in does (see env(3)). The
+/*	batch mode of eval(3) gives each job an empty list, and a global
+/*	context of its own, with use_modules(), which makes a list
+/*	current in the calling thread, or an empty one if m is 0, and
+/*	returns the list it replaces. free_modules() frees a list that
+/*	is no longer current.
+/* DIAGNOSTICS
+/*	Syntax errors are reported by read(3), before any statement of
+/*	the file is evaluated. A file whose load failed, with a syntax
+/*	error or an error in one of its statements, is evaluated whole
+/*	the next time it is loaded.
+/*--*/
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#if defined(_WIN32)
+#define fileno	_fileno
+#define fstat	_fstat
+#define stat	_stat
+#endif
+
+#include "types.h"
+#include "env.h"
+#include "exp.h"
+#include "gc.h"
+#include "par.h"
+#include "read.h"
+#include "resolve.h"
+#include "module.h"
+
+
+ /* structure definitions */
+
+typedef unsigned long long Hash;
+
+typedef struct Statement Statement;
+
+struct Statement {
+	Hash     hash;		/* of the resolved statement */
+	Symbol  *defs;		/* names it assigns */
+	int      ndefs;
+	Symbol  *refs;		/* global names it refers to */
+	int      nrefs;
+};
+
+struct Module {
+	wchar_t   *path;
+	time_t     mtime;
+	long       size;
+	time_t     checked;	/* when it was last loaded */
+	Hash       hash;	/* of the contents */
+	Statement *stmts;
+	int        nstmts;
+	bool       loaded;	/* false until a load succeeds */
+	Module    *link;
+};
+
+typedef struct Set Set;
+
+struct Set {			/* open-addressing set of hashes */
+	Hash *keys;		/* 0 for an empty entry */
+	int   n;
+	int   size;		/* a power of 2 */
+};
+
+
+ /* static data */
+
+static THREAD_LOCAL Module *modules = 0;	/* of the current context */
+
+
+/* hash_bytes - hashes a byte string, continuing from h */
+
+static Hash hash_bytes(Hash h, const void *buf, size_t n)
+{
+	const unsigned char *p = buf;
+
+	while (n-- > 0) {
+		h = (h ^ *p++) * 1099511628211ull;
+	}
+
+	return h;
+}
+
+
+/* hash_exp - hashes the structure of an expression */
+
+static Hash hash_exp(const Exp *exp)
+{
+	Hash h = 14695981039346656037ull;
+	int  i;
+
+	h = hash_bytes(h, &exp->type, sizeof(exp->type));
+	switch (exp->type) {
+	case T_Exp_Symbol:
+	case T_Exp_Local:
+	case T_Exp_Global:
+		h = hash_bytes(h, exp->sval,
+			wcslen(exp->sval) * sizeof(*exp->sval));
+		h = hash_bytes(h, &exp->nval, sizeof(exp->nval));
+		break;
+	case T_Exp_Num:
+		h = hash_bytes(h, &exp->num, sizeof(exp->num));
+		break;
+	default:
+		for (i = 0; i < exp_arity(exp); i++) {
+			h = (h ^ hash_exp(exp->child[i])) * 1099511628211ull;
+		}
+		break;
+	}
+
+	return h;
+}
+
+
+/* set_find - returns the entry of a key in a set */
+
+static Hash *set_find(const Set *set, Hash key)
+{
+	int i, mask = set->size - 1;
+
+	for (i = (int)(key >> 7) & mask; set->keys[i] != 0;
+	     i = (i + 1) & mask) {
+		if (set->keys[i] == key) {
+			break;
+		}
+	}
+
+	return &set->keys[i];
+}
+
+
+/* set_add - adds a key to a set; returns false if it was there */
+
+static bool set_add(Set *set, Hash key)
+{
+	Hash *keys = set->keys, *entry = 0;
+	int   i, size = set->size;
+
+	key = key != 0 ? key : 1;
+	if (2 * (set->n + 1) > set->size) {
+		set->size = size != 0 ? 2 * size : 256;
+		set->keys = calloc(set->size, sizeof(*set->keys));
+		assert(set->keys != 0);
+		for (i = 0; i < size; i++) {
+			if (keys[i] != 0) {
+				*set_find(set, keys[i]) = keys[i];
+			}
+		}
+		free(keys);
+	}
+
+	if (*(entry = set_find(set, key)) != 0) {
+		return false;
+	}
+	*entry = key;
+	++set->n;
+
+	return true;
+}
+
+
+/* set_has - tests whether a key is in a set */
+
+static bool set_has(const Set *set, Hash key)
+{
+	key = key != 0 ? key : 1;
+
+	return set->size != 0 && *set_find(set, key) != 0;
+}
+
+
+/* add_name - adds a name to a list unless it is there */
+
+static void add_name(Symbol **names, int *n, int *max, Symbol name)
+{
+	int i;
+
+	for (i = 0; i < *n; i++) {
+		if ((*names)[i] == name) {
+			return;
+		}
+	}
+	if (*n == *max) {
+		*max = *max != 0 ? 2 * *max : 4;
+		*names = realloc(*names, *max * sizeof(**names));
+		assert(*names != 0);
+	}
+	(*names)[(*n)++] = name;
+}
+
+
+/* collect - collects the names a statement assigns and refers to */
+
+static void collect(const Exp *exp, Statement *stmt, int *maxdefs,
+		    int *maxrefs)
+{
+	int i;
+
+	switch (exp->type) {
+	case T_Exp_Global:
+		add_name(&stmt->refs, &stmt->nrefs, maxrefs, exp->sval);
+		break;
+	case T_Exp_Assign:
+		add_name(&stmt->defs, &stmt->ndefs, maxdefs,
+			exp->child[0]->sval);
+		collect(exp->child[1], stmt, maxdefs, maxrefs);
+		break;
+	case T_Exp_Quote:
+		break;
+	default:
+		for (i = 0; i < exp_arity(exp); i++) {
+			collect(exp->child[i], stmt, maxdefs, maxrefs);
+		}
+		break;
+	}
+}
+
+
+/* free_statements - frees the statements of a module */
+
+static void free_statements(Statement *stmts, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++) {
+		free(stmts[i].defs);
+		free(stmts[i].refs);
+	}
+	free(stmts);
+}
+
+
+/* find_module - returns the module of a path, or makes one */
+
+static Module *find_module(const wchar_t *path)
+{
+	Module *m = 0;
+
+	for (m = modules; m != 0; m = m->link) {
+		if (wcscmp(m->path, path) == 0) {
+			return m;
+		}
+	}
+
+	m = calloc(1, sizeof(*m));
+	assert(m != 0);
+	m->path = malloc((wcslen(path) + 1) * sizeof(*path));
+	assert(m->path != 0);
+	wcscpy(m->path, path);
+	m->link = modules;
+	modules = m;
+
+	return m;
+}
+
+
+/* hash_file - hashes the contents of a stream, and rewinds it */
+
+static Hash hash_file(FILE *in)
+{
+	char   buf[64 * 1024];
+	size_t n;
+	Hash   h = 14695981039346656037ull;
+
+	while ((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+		h = hash_bytes(h, buf, n);
+	}
+	rewind(in);
+
+	return h;
+}
+
+
+/* mark_dirty - marks the statements to evaluate: those that are new,
+   and those that refer to a name another one marked assigns */
+
+static void mark_dirty(const Module *old, Statement *stmts, int n,
+		       bool *dirty)
+{
+	Set  seen = { 0, 0, 0 }, changed = { 0, 0, 0 };
+	bool more = true;
+	int  i, j;
+
+	for (i = 0; old != 0 && i < old->nstmts; i++) {
+		set_add(&seen, old->stmts[i].hash);
+	}
+	for (i = 0; i < n; i++) {
+		dirty[i] = old == 0 || !set_has(&seen, stmts[i].hash);
+		for (j = 0; dirty[i] && j < stmts[i].ndefs; j++) {
+			set_add(&changed, (Hash)(size_t)stmts[i].defs[j]);
+		}
+	}
+
+	/* names may be used before they are defined: repeat until no
+	   more names change */
+	while (more) {
+		more = false;
+		for (i = 0; i < n; i++) {
+			for (j = 0; !dirty[i] && j < stmts[i].nrefs; j++) {
+				dirty[i] = set_has(&changed,
+					(Hash)(size_t)stmts[i].refs[j]);
+			}
+			for (j = 0; dirty[i] && j < stmts[i].ndefs; j++) {
+				more |= set_add(&changed,
+					(Hash)(size_t)stmts[i].defs[j]);
+			}
+		}
+	}
+
+	free(seen.keys);
+	free(changed.keys);
+}
+
+
+/* module_load - loads a source file, evaluating what has changed since
+   it was last loaded; returns the number of statements evaluated */
+
+int module_load(const wchar_t *path, FILE *in, Execute run, int *nread)
+{
+	Module      *m = find_module(path);
+	Reader      *rd = 0;
+	const Exp  **exps = 0, *exp = 0;
+	Statement   *stmts = 0;
+	bool        *dirty = 0;
+	struct stat  st;
+	Hash         hash;
+	int          n = 0, max = 0, nrun = 0, i, maxdefs, maxrefs;
+
+	if (!m->loaded) {		/* the last load failed */
+		free_statements(m->stmts, m->nstmts);
+		m->stmts  = 0;
+		m->nstmts = 0;
+	}
+	if (fstat(fileno(in), &st) != 0) {
+		st.st_mtime = 0;
+		st.st_size  = -1;
+	}
+	*nread = m->nstmts;
+	if (m->stmts != 0 && st.st_mtime == m->mtime
+	    && (long)st.st_size == m->size && m->mtime < m->checked) {
+		return 0;
+	}
+	hash = hash_file(in);
+	m->mtime   = st.st_mtime;
+	m->size    = (long)st.st_size;
+	m->checked = time(0);
+	if (m->stmts != 0 && hash == m->hash) {
+		return 0;
+	}
+	m->loaded = false;
+
+	/* resolving a statement may grow the global environment */
+	par_quiesce();
+	rd = reader_open(in);
+	while ((exp = read_statement(rd)) != 0) {
+		if (n == max) {
+			max = max != 0 ? 2 * max : 64;
+			exps  = realloc(exps, max * sizeof(*exps));
+			stmts = realloc(stmts, max * sizeof(*stmts));
+			assert(exps != 0 && stmts != 0);
+		}
+		exps[n] = resolve(exp);
+		memset(&stmts[n], 0, sizeof(stmts[n]));
+		stmts[n].hash = hash_exp(exps[n]);
+		maxdefs = maxrefs = 0;
+		collect(exps[n], &stmts[n], &maxdefs, &maxrefs);
+		++n;
+	}
+	reader_close(rd);
+
+	dirty = malloc((n + 1) * sizeof(*dirty));
+	assert(dirty != 0);
+	mark_dirty(m->stmts != 0 ? m : 0, stmts, n, dirty);
+
+	free_statements(m->stmts, m->nstmts);
+	m->stmts  = stmts;
+	m->nstmts = n;
+	m->hash   = hash;
+	*nread = n;
+
+	/* the collector does not run while statements are read, so
+	   the expressions need protecting only from here on */
+	for (i = 0; i < n; i++) {
+		gc_protect(&exps[i]);
+	}
+	for (i = 0; i < n; i++) {
+		if (dirty[i]) {
+			run(exps[i], get_global_environment());
+			++nrun;
+			par_quiesce();
+		}
+	}
+	gc_unprotect(n);
+	m->loaded = true;
+
+	free(exps);
+	free(dirty);
+
+	return nrun;
+}
+
+
+/* use_modules - makes a list of modules current in the calling thread,
+   and returns the one it replaces */
+
+Module *use_modules(Module *m)
+{
+	Module *old = modules;
+
+	modules = m;
+
+	return old;
+}
+
+
+/* free_modules - frees a list of modules */
+
+void free_modules(Module *m)
+{
+	Module *next = 0;
+
+	for (; m != 0; m = next) {
+		next = m->link;
+		free_statements(m->stmts, m->nstmts);
+		free(m->path);
+		free(m);
+	}
+}
@@ -0,0 +1,26 @@
+#ifndef _MODULE_H_INCLUDED_
+#define _MODULE_H_INCLUDED_
+#include <stdio.h>
+#include "types.h"
+/*++
+/* NAME
+/*	module 3h
+/* SUMMARY
+/*	Cache of loaded source files.
+/* DESCRIPTION
+/* .nf
+
+ /* Execute - evaluates a statement */
+
+typedef const Value *(*Execute)(const Exp *exp, Env *env);
+
+ /* Function prototypes */
+
+int	 module_load(const wchar_t *path, FILE *in, Execute run, int *nread);
+Module	*use_modules(Module *m);
+void	 free_modules(Module *m);
+
+/* AUTHOR
+/*	Brent Harp
+/*--*/
+#endif
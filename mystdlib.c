@@ -7,8 +7,9 @@
 /*	void	*mymalloc(sz);
 /*	size_t	sz;
 /* DESCRIPTION
-/*	Memory allocation errors are fatal errors. There is no garbage
-/*	collector at this point.
+/*	Memory allocation errors are fatal errors. Objects of the
+/*	evaluator are allocated by gc_alloc() and garbage collected;
+/*	see gc(3).
 /*--*/
 
 #include <assert.h>
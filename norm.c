@@ -0,0 +1,355 @@
+/*++
+/* NAME
+/*	norm 3
+/* SUMMARY
+/*	Normalization by evaluation.
+/* SYNOPSIS
+/*	#include <norm.h>
+/*
+/*	const Exp   *normalize(val);
+/*	const Value *val;
+/*
+/*	const Value *norm_builtin(fn, arg);
+/*	const Function *fn;
+/*	const Value *arg;
+/*
+/*	long	norm_budget;
+/*
+/*	void	scan_norm();
+/*
+/*	void	norm_reset();
+/* DESCRIPTION
+/*	eval(3) reduces a term to weak head normal form: it does not
+/*	reduce under a lambda. normalize() returns the beta-normal form
+/*	of a value as an expression.
+/*
+/*	The value is forced. A function is applied to a fresh variable,
+/*	a neutral value, and the result is normalized in turn to give
+/*	the body of a lambda. A neutral value applied to an argument is
+/*	another neutral value, which remembers the application, so the
+/*	evaluators run the body as usual and no substitution is done on
+/*	expressions: the reductions are the lazy, shared reductions of
+/*	the evaluator. A neutral application reads back as the
+/*	application of its head to the normal forms of its arguments.
+/*	Native numbers and quotations are their own normal forms.
+/*
+/*	Bound variables keep the names of the lambda parameters they
+/*	come from, with a number appended where that would capture an
+/*	enclosing variable.
+/*
+/*	Each function opened and each neutral application read back is
+/*	a step. After norm_budget steps, the remaining subterms are read
+/*	back as the symbol `...'. Set norm_budget to 0 for no limit.
+/*	The normal form may not nest deeper than NORM_MAX_DEPTH, as
+/*	printing it, and the other modules that walk expressions,
+/*	recurse in C; a term that diverges under a lambda, like an
+/*	infinite list, goes past that depth long before the budget runs
+/*	out.
+/*
+/*	normalize() keeps its work and the normal forms read back so far
+/*	on stacks of its own, so deep terms do not recurse in C.
+/*
+/*	norm_builtin() is the normalize builtin. It returns the normal
+/*	form of its argument as a quotation.
+/*
+/*	scan_norm() marks the objects on the stacks of normalize() for
+/*	the garbage collector.
+/*
+/*	The names of a normal form are chosen with bind_symbol() (see
+/*	symbol(3)), which all threads share, so one thread normalizes
+/*	at a time, and the jobs of the batch mode of eval(3) take turns.
+/*	norm_reset() releases the names and the turn of a normalization
+/*	cut short by an error (see fail() in eval(3)).
+/* DIAGNOSTICS
+/*	Normalizing a value that is not a term, or whose normal form
+/*	nests deeper than NORM_MAX_DEPTH, is an error.
+/*--*/
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "types.h"
+#include "gc.h"
+#include "env.h"
+#include "eval.h"
+#include "exp.h"
+#include "par.h"
+#include "symbol.h"
+#include "norm.h"
+
+
+ /* structure definitions */
+
+typedef struct Task  Task;
+
+enum Task_Kind {
+	N_Read,			/* read back val */
+	N_Pair,			/* pair the last two results */
+	N_Lambda		/* make a lambda of name and the last result */
+};
+
+struct Task {
+	enum Task_Kind kind;
+	const Value   *val;
+	Symbol         name;
+	int            depth;	/* N_Read: of the subterm */
+};
+
+
+ /* static data */
+
+long norm_budget = NORM_BUDGET;
+
+static long steps = 0;			/* steps taken by normalize() */
+
+static Task       *tasks    = 0;	/* work to do */
+static int         ntasks   = 0;
+static int         maxtasks = 0;
+
+static const Exp **results  = 0;	/* normal forms read back */
+static int         nresults = 0;
+static int         maxresults = 0;
+
+static Mutex       lock = MUTEX_INITIALIZER;	/* guards the above */
+static THREAD_LOCAL int nesting = 0;	/* of normalize() calls */
+
+
+
+ /* function prototypes */
+
+static const Value *neutral_apply(const Function *fn, const Value *arg);
+
+
+/* make_neutral - makes a neutral value applying head to arg, or a
+   variable if head is 0 */
+
+static const Value *make_neutral(Symbol name, const Value *head,
+				 const Value *arg)
+{
+	Value    *val = 0;
+	Function *fn  = 0;
+
+	val = alloc_value(T_Function);
+	fn  = val->data.function;
+	fn->name  = name;
+	fn->param = 0;
+	fn->body  = 0;
+	fn->env   = 0;
+	fn->apply = neutral_apply;
+	fn->code  = 0;
+
+	if (head != 0) {
+		fn->env = link(name, arg, link(name, head, 0));
+	}
+
+	return val;
+}
+
+
+/* neutral_apply - applies a neutral value */
+
+static const Value *neutral_apply(const Function *fn, const Value *arg)
+{
+	return make_neutral(fn->name, VALUE_OF(fn), arg);
+}
+
+
+/* push_task - pushes a task */
+
+static void push_task(enum Task_Kind kind, const Value *val, Symbol name,
+		      int depth)
+{
+	Task *t = 0;
+
+	if (ntasks == maxtasks) {
+		maxtasks = maxtasks != 0 ? 2 * maxtasks : 1024;
+		tasks = realloc(tasks, maxtasks * sizeof(*tasks));
+		assert(tasks != 0);
+	}
+
+	t = &tasks[ntasks++];
+	t->kind  = kind;
+	t->val   = val;
+	t->name  = name;
+	t->depth = depth;
+}
+
+
+/* push_result - pushes a normal form */
+
+static void push_result(const Exp *exp)
+{
+	if (nresults == maxresults) {
+		maxresults = maxresults != 0 ? 2 * maxresults : 1024;
+		results = realloc(results, maxresults * sizeof(*results));
+		assert(results != 0);
+	}
+
+	results[nresults++] = exp;
+}
+
+
+/* read_value - reads back the value of the task on top of the stack */
+
+static void read_value(void)
+{
+	const Value    *val = 0, *body = 0;
+	const Function *fn  = 0;
+	Symbol          name = 0;
+	int             depth = tasks[ntasks - 1].depth;
+
+	if (depth > NORM_MAX_DEPTH) {
+		fwprintf(stderr, L"%s: normal form too large: deeper than %d\n",
+			"normalize", NORM_MAX_DEPTH);
+		fail();
+	}
+	if (norm_budget > 0 && ++steps > norm_budget) {
+		--ntasks;
+		push_result(make_symbol_exp(intern(L"...")));
+		return;
+	}
+
+	/* the task keeps the value alive while it is forced */
+	val = tasks[ntasks - 1].val = force(tasks[ntasks - 1].val);
+
+	switch (val->type) {
+	case T_Num:
+		--ntasks;
+		push_result(make_num_exp(val->data.num));
+		break;
+
+	case T_Exp:
+		--ntasks;
+		push_result(make_quote_exp(val->data.exp));
+		break;
+
+	case T_Function:
+		fn = val->data.function;
+		if (fn->apply == neutral_apply && fn->env == 0) {
+			--ntasks;
+			push_result(make_symbol_exp(fn->name));
+		} else if (fn->apply == neutral_apply) {
+			--ntasks;
+			push_task(N_Pair, 0, 0, 0);
+			push_task(N_Read, lookup_local(0, fn->env), 0,
+				depth + 1);
+			push_task(N_Read, lookup_local(1, fn->env), 0,
+				depth + 1);
+		} else {
+			name = bind_symbol(fn->param != 0 ? fn->param->sval
+				: intern(L"x"));
+			tasks[ntasks - 1].name = name;	/* for norm_reset() */
+			body = call(val, make_neutral(name, 0, 0));
+			--ntasks;
+			push_task(N_Lambda, 0, name, 0);
+			push_task(N_Read, body, 0, depth + 1);
+		}
+		break;
+
+	default:
+		fwprintf(stderr, L"%s: %d: %s: cannot normalize value of"
+			L" type %d\n", __FILE__, __LINE__, "read_value",
+			val->type);
+		fail();
+	}
+}
+
+
+/* normalize - returns the normal form of a value */
+
+const Exp *normalize(const Value *val)
+{
+	const Exp *exp = 0, *arg = 0;
+	int base, rbase;
+	Task t;
+
+	if (nesting++ == 0) {
+		/* wait for the turn parked, as the holder may collect */
+		gc_park();
+		par_lock(&lock);
+		gc_unpark();
+	}
+
+	base  = ntasks;
+	rbase = nresults;
+	steps = 0;
+	push_task(N_Read, val, 0, 0);
+
+	while (ntasks > base) {
+		t = tasks[ntasks - 1];
+		switch (t.kind) {
+		case N_Read:
+			read_value();
+			break;
+
+		case N_Pair:
+			--ntasks;
+			arg = results[--nresults];
+			exp = results[--nresults];
+			push_result(make_pair_exp(exp, arg));
+			break;
+
+		case N_Lambda:
+			--ntasks;
+			exp = results[--nresults];
+			push_result(make_lambda_exp(make_symbol_exp(t.name), exp));
+			unbind_symbol(t.name);
+			break;
+		}
+	}
+
+	assert(nresults == rbase + 1);
+
+	exp = results[--nresults];
+	if (--nesting == 0) {
+		par_unlock(&lock);
+	}
+
+	return exp;
+}
+
+
+/* scan_norm - marks the values and expressions of normalize() */
+
+void scan_norm(void)
+{
+	int i;
+
+	for (i = 0; i < ntasks; i++) {
+		gc_mark(tasks[i].val);
+	}
+	for (i = 0; i < nresults; i++) {
+		gc_mark(results[i]);
+	}
+}
+
+
+/* norm_reset - gives up the normalizations under way in the calling
+   thread */
+
+void norm_reset(void)
+{
+	if (nesting == 0) {
+		return;
+	}
+
+	while (ntasks > 0) {
+		--ntasks;
+		if (tasks[ntasks].name != 0) {
+			unbind_symbol(tasks[ntasks].name);
+		}
+	}
+	nresults = 0;
+	nesting  = 0;
+	par_unlock(&lock);
+}
+
+
+/* norm_builtin - the normalize builtin */
+
+const Value *norm_builtin(const Function *fn, const Value *arg)
+{
+	abandon();
+	return make_exp_value(normalize(arg));
+}
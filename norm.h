@@ -0,0 +1,29 @@
+#ifndef _NORM_H_INCLUDED_
+#define _NORM_H_INCLUDED_
+#include "types.h"
+/*++
+/* NAME
+/*	norm 3h
+/* SUMMARY
+/*	Normalization by evaluation.
+/* DESCRIPTION
+/* .nf
+
+ /* constants */
+
+#define NORM_BUDGET (1000 * 1000)	/* default norm_budget */
+#define NORM_MAX_DEPTH (10 * 1000)	/* of a normal form */
+
+extern long norm_budget;
+
+ /* Function prototypes */
+
+const Exp   *normalize(const Value *val);
+const Value *norm_builtin(const Function *fn, const Value *arg);
+void	     scan_norm(void);
+void	     norm_reset(void);
+
+/* AUTHOR
+/*	Brent Harp
+/*--*/
+#endif
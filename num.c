@@ -6,29 +6,336 @@
 /* SYNOPSIS
 /*	#include <num.h>
 /*
-/*	const Exp	*church_encode(const unsigned int n);
+/*	const Exp	*church_exp(n);
+/*	Number	n;
+/*
+/*	Number	num_of(val);
+/*	const Value	*val;
+/*
+/*	bool	num_strict(proc);
+/*	Procedure	proc;
+/*
+/*	void	scan_num();
 /* DESCRIPTION
-/*  The function church_encode() takes a constant
-/*  integer and returns the "Church encoding" of that integer;
-/*  that is, a function of two arguments, f and x, that applies
-/*  function f to x, n times.
+/*  church_exp() returns a resolved expression equivalent to the
+/*  Church encoding of n (see resolve(3)), the function of f and x
+/*  that applies f to x n times: \f.\x.x for 0 and \f.\x.(f (m f x))
+/*  for n = m + 1, where m is a native number. Its size does not
+/*  depend on n, and the applications of f are built lazily, as they
+/*  are forced. Recently used encodings are
+/*  cached, so applying the same native number repeatedly does not
+/*  rebuild it.
+/*
+/*  num_of() returns the native number a value denotes. A Church
+/*  numeral is converted by applying it to the succ builtin and 0.
+/*
+/*  The builtins succ, pred, add, mul, iszero, equal and less
+/*  compute on native numbers in constant time. They accept native
+/*  numbers and Church numerals alike. Native numbers are 64 bits
+/*  wide: a succ, add or mul whose result does not fit is an error
+/*  (see fail() in eval(3)), not a wrapped number. pred of 0 is 0. The
+/*  predicates return the Church booleans \x.\y.x and \x.\y.y.
+/*  The builtins of two arguments are curried: applied to the first
+/*  argument they return a builtin holding it in its environment.
+/*
+/*  num_strict() returns true for the procedures of these builtins.
+/*  eval(3) forces their argument to a native number before it
+/*  applies them, on its own stack, so num_of() finds one and does
+/*  not have to run the evaluator again in C. The builtins are thus
+/*  strict in each argument as it is applied: add of an argument
+/*  whose evaluation does not end does not end either.
+/*
+/*  scan_num() marks the cached expressions for the garbage
+/*  collector. The caches are locked while they are used, as the
+/*  worker threads of par(3) compute on numbers too.
 /* AUTHOR
 /*  Brent Harp
 /*--*/
 
+#include <stdio.h>
+#include <stdlib.h>
+
 #include "num.h"
 #include "exp.h"
+#include "env.h"
+#include "eval.h"
+#include "gc.h"
+#include "par.h"
+#include "resolve.h"
+#include "symbol.h"
+
+
+ /* static data */
+
+#define NUM_CACHE_SIZE 256			/* a power of 2 */
+
+static struct {
+	Number     n;
+	const Exp *exp;
+} cache[NUM_CACHE_SIZE];			/* resolved church numerals */
+
+static const Exp *booleans[2];			/* false and true */
+
+static Mutex lock = MUTEX_INITIALIZER;		/* guards the above */
+
+
+ /* function prototypes */
+
+static const Value *make_boolean(bool b);
+static const Value *make_partial(const Function *fn, Procedure proc,
+				 const Value *arg);
+static void operands(const Function *fn, const Value *arg,
+		     Number *m, Number *n);
+static void overflow(const char *name);
+
+
+/* church_exp - returns the resolved Church encoding of n */
+
+const Exp *church_exp(Number n)
+{
+	Symbol     f = intern(L"f"), x = intern(L"x");
+	const Exp *body = 0, *exp = 0;
+	int i = n & (NUM_CACHE_SIZE - 1);
+
+	par_lock(&lock);
+	if (cache[i].exp == 0 || cache[i].n != n) {
+		body = make_local_exp(x, 0);
+		if (n > 0) {
+			body = make_pair_exp(make_pair_exp(make_num_exp(n - 1),
+				make_local_exp(f, 1)), body);
+			body = make_pair_exp(make_local_exp(f, 1), body);
+		}
+		cache[i].exp = make_lambda_exp(make_symbol_exp(f),
+			make_lambda_exp(make_symbol_exp(x), body));
+		cache[i].n   = n;
+	}
+	exp = cache[i].exp;
+	par_unlock(&lock);
+
+	return exp;
+}
+
+
+/* scan_num - marks the cached expressions */
+
+void scan_num(void)
+{
+	int i;
 
-const Exp *church_encode(const unsigned int n)
+	for (i = 0; i < NUM_CACHE_SIZE; i++) {
+		gc_mark(cache[i].exp);
+	}
+	gc_mark(booleans[0]);
+	gc_mark(booleans[1]);
+}
+
+
+/* num_of - returns the native number a value denotes */
+
+Number num_of(const Value *val)
+{
+	const Value *succ = 0, *zero = 0;
+
+	val = force(val);
+	if (val->type == T_Num) {
+		return val->data.num;
+	}
+
+	/* a builtin on numbers is no numeral, and applying it to succ
+	   would come back here */
+	if (val->type == T_Function
+	    && !num_strict(val->data.function->apply)) {
+		gc_protect(&val);
+		gc_protect(&succ);
+		gc_protect(&zero);
+		succ = make_builtin(L"succ", num_succ);
+		zero = make_num_value(0);
+		val  = force(call(force(call(val, succ)), zero));
+		gc_unprotect(3);
+	}
+
+	if (val->type != T_Num) {
+		abandon();
+		fwprintf(stderr, L"%s: not a number\n", "num");
+		fail();
+	}
+
+	return val->data.num;
+}
+
+
+/* num_strict - tells whether a procedure is a builtin on numbers */
+
+bool num_strict(Procedure proc)
 {
-	const Exp    *f = make_symbol_exp(L"f");
-	const Exp    *x = make_symbol_exp(L"x");
-	const Exp    *e = x;
-	unsigned int  i = n;
+	return proc == num_succ || proc == num_pred || proc == num_iszero
+	    || proc == num_add || proc == num_add2
+	    || proc == num_mul || proc == num_mul2
+	    || proc == num_equal || proc == num_equal2
+	    || proc == num_less || proc == num_less2;
+}
+
 
-	while (i--) {
-		e = make_pair_exp(f, e);
+/* make_boolean - makes a Church boolean */
+
+static const Value *make_boolean(bool b)
+{
+	Symbol     x = intern(L"x"), y = intern(L"y");
+	const Exp *exp = 0;
+
+	par_lock(&lock);
+	if (booleans[b] == 0) {
+		booleans[b] = resolve(make_lambda_exp(make_symbol_exp(x),
+			make_lambda_exp(make_symbol_exp(y),
+				make_symbol_exp(b ? x : y))));
 	}
+	exp = booleans[b];
+	par_unlock(&lock);
+
+	return eval(exp, get_global_environment());
+}
+
+
+/* make_partial - makes a builtin holding its first argument */
+
+static const Value *make_partial(const Function *fn, Procedure proc,
+				 const Value *arg)
+{
+	const Value *val = 0;
+
+	gc_protect(&arg);
+	val = make_builtin(fn->name, proc);
+	val->data.function->env = link(fn->name, arg, 0);
+	gc_unprotect(1);
+
+	return val;
+}
+
+
+/* operands - the numbers a curried builtin is applied to */
+
+static void operands(const Function *fn, const Value *arg,
+		     Number *m, Number *n)
+{
+	gc_protect(&arg);
+	*m = num_of(lookup_local(0, fn->env));
+	*n = num_of(arg);
+	gc_unprotect(1);
+}
+
+
+/* overflow - reports a result too large for a native number */
+
+static void overflow(const char *name)
+{
+	abandon();
+	fwprintf(stderr, L"%s: %s: result larger than %llu\n", "num", name,
+		NUMBER_MAX);
+	fail();
+}
+
+
+/* num_succ - the successor of a number */
+
+const Value *num_succ(const Function *fn, const Value *arg)
+{
+	Number n = num_of(arg);
+
+	if (n == NUMBER_MAX) {
+		overflow("succ");
+	}
+
+	return make_num_value(n + 1);
+}
+
+
+/* num_pred - the predecessor of a number, or 0 */
+
+const Value *num_pred(const Function *fn, const Value *arg)
+{
+	Number n = num_of(arg);
+
+	return make_num_value(n > 0 ? n - 1 : 0);
+}
+
+
+/* num_iszero - tests a number for zero */
+
+const Value *num_iszero(const Function *fn, const Value *arg)
+{
+	return make_boolean(num_of(arg) == 0);
+}
+
+
+/* num_add - adds two numbers */
+
+const Value *num_add(const Function *fn, const Value *arg)
+{
+	return make_partial(fn, num_add2, arg);
+}
+
+const Value *num_add2(const Function *fn, const Value *arg)
+{
+	Number m, n;
+
+	operands(fn, arg, &m, &n);
+	if (m > NUMBER_MAX - n) {
+		overflow("add");
+	}
+
+	return make_num_value(m + n);
+}
+
+
+/* num_mul - multiplies two numbers */
+
+const Value *num_mul(const Function *fn, const Value *arg)
+{
+	return make_partial(fn, num_mul2, arg);
+}
+
+const Value *num_mul2(const Function *fn, const Value *arg)
+{
+	Number m, n;
+
+	operands(fn, arg, &m, &n);
+	if (n != 0 && m > NUMBER_MAX / n) {
+		overflow("mul");
+	}
+
+	return make_num_value(m * n);
+}
+
+
+/* num_equal - tests two numbers for equality */
+
+const Value *num_equal(const Function *fn, const Value *arg)
+{
+	return make_partial(fn, num_equal2, arg);
+}
+
+const Value *num_equal2(const Function *fn, const Value *arg)
+{
+	Number m, n;
+
+	operands(fn, arg, &m, &n);
+
+	return make_boolean(m == n);
+}
+
+
+/* num_less - tests whether a number is less than another */
+
+const Value *num_less(const Function *fn, const Value *arg)
+{
+	return make_partial(fn, num_less2, arg);
+}
+
+const Value *num_less2(const Function *fn, const Value *arg)
+{
+	Number m, n;
+
+	operands(fn, arg, &m, &n);
 
-	return make_lambda_exp(f, make_lambda_exp(x, e));
-}
\ No newline at end of file
+	return make_boolean(m < n);
+}
@@ -14,9 +14,29 @@
 
  /* function prototypes */
 
-const Exp *church_encode(const unsigned int n);
+const Exp   *church_exp(Number n);
+Number	     num_of(const Value *val);
+bool	     num_strict(Procedure proc);
+void	     scan_num(void);
+
+ /* builtins */
+
+const Value *num_succ(const Function *fn, const Value *arg);
+const Value *num_pred(const Function *fn, const Value *arg);
+const Value *num_add(const Function *fn, const Value *arg);
+const Value *num_mul(const Function *fn, const Value *arg);
+const Value *num_iszero(const Function *fn, const Value *arg);
+const Value *num_equal(const Function *fn, const Value *arg);
+const Value *num_less(const Function *fn, const Value *arg);
+
+ /* curried builtins, holding their first argument */
+
+const Value *num_add2(const Function *fn, const Value *arg);
+const Value *num_mul2(const Function *fn, const Value *arg);
+const Value *num_equal2(const Function *fn, const Value *arg);
+const Value *num_less2(const Function *fn, const Value *arg);
 
 /* AUTHOR
 /*	Brent Harp
 /*--*/
-#endif
\ No newline at end of file
+#endif
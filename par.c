@@ -0,0 +1,725 @@
+/*++
+/* NAME
+/*	par 3
+/* SUMMARY
+/*	Speculative parallel evaluation.
+/* SYNOPSIS
+/*	#include <par.h>
+/*
+/*	void	par_start(n);
+/*	int	n;
+/*
+/*	void	par_batch(n);
+/*	int	n;
+/*
+/*	void	par_run(njobs, job);
+/*	long	njobs;
+/*	Job	job;
+/*
+/*	void	par_spark(val);
+/*	const Value *val;
+/*
+/*	void	par_quiesce();
+/*
+/*	int	par_self();
+/*
+/*	void	par_lock(mtx);
+/*	Mutex	*mtx;
+/*
+/*	void	par_unlock(mtx);
+/*	Mutex	*mtx;
+/*
+/*	void	par_wait(cond, mtx);
+/*	Cond	*cond;
+/*	Mutex	*mtx;
+/*
+/*	void	par_broadcast(cond);
+/*	Cond	*cond;
+/*
+/*	void	par_pause(n);
+/*	int	n;
+/*
+/*	void	sweep_par();
+/*
+/*	void	par_report(stream);
+/*	FILE	*stream;
+/*
+/*	int	par_threads;
+/*
+/*	bool	par_sparking;
+/*
+/*	long	par_quiescing;
+/* DESCRIPTION
+/*	Lazy evaluation leaves many thunks that are independent of each
+/*	other and are all forced in the end, such as the two arguments of
+/*	add. With the --par option, the evaluator hands some of them to a
+/*	pool of worker threads, which evaluate them speculatively while
+/*	the main thread goes on.
+/*
+/*	par_start() starts n worker threads, and registers the main thread
+/*	and each worker with the evaluator, the collector and the arena
+/*	(see eval(3), gc(3) and arena(3)). It is called once, with n = 0
+/*	when the evaluator runs sequentially; par_threads is n, and
+/*	par_sparking is set when n is not 0.
+/*
+/*	par_batch() is called instead of par_start() by the batch mode
+/*	of eval(3), which runs independent jobs rather than speculating.
+/*	It starts n - 1 workers, which make no sparks. par_run() then
+/*	calls job(i) for each i from 0 to njobs - 1, on the main thread
+/*	and the workers alike, so n jobs run at a time, and returns when
+/*	every job is done. It is called once.
+/*
+/*	par_spark() offers a thunk for speculative evaluation. Each thread
+/*	keeps the sparks it makes in a bounded queue; when the queue is
+/*	full the spark is dropped. An idle worker steals the oldest spark
+/*	of another thread, and forces it with speculate() (see eval(3)),
+/*	unless it was evaluated or taken for evaluation meanwhile. A spark
+/*	made while forcing a spark is one deeper; sparks deeper than
+/*	PAR_DEPTH are not made, so a speculation that nobody demands,
+/*	such as the branch of a conditional not taken, cannot go on
+/*	making more of them. The
+/*	queues do not keep their sparks alive: sweep_par() drops the
+/*	sparks the garbage collector did not mark, and those that fizzled,
+/*	before the arena is swept.
+/*
+/*	par_quiesce() stops the speculation started by the current
+/*	statement, if par_sparking is set. It sets par_quiescing, which
+/*	makes each worker give up its evaluation at the next safe point,
+/*	waits until every worker is idle, and empties the queues. The
+/*	REPL and the load builtin call it between statements, as
+/*	resolving a statement may grow the global environment.
+/*
+/*	par_self() returns the number of the calling thread: 0 for the
+/*	main thread and 1 to n for the workers.
+/*
+/*	par_lock(), par_unlock(), par_wait() and par_broadcast() wrap the
+/*	mutexes and condition variables of the system. par_lock() and
+/*	par_unlock() do nothing when par_threads is 0, so the modules
+/*	that guard shared data with them pay nothing sequentially.
+/*	par_pause() backs off the n-th time a thread finds nothing to do:
+/*	it yields the processor at first, and then sleeps briefly.
+/*
+/*	par_report() writes the number of sparks made, dropped, fizzled,
+/*	evaluated and given up to stream.
+/*
+/*	The header par.h also defines THREAD_LOCAL, for data each thread
+/*	has a copy of, and the atomic loads, stores and compare and swap
+/*	operations on pointers and longs the threads synchronize with.
+/*	Loads acquire and stores release.
+/* DIAGNOSTICS
+/*	Failure to start a thread is a fatal error.
+/*--*/
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if !defined(_WIN32)
+#include <sched.h>
+#include <time.h>
+#endif
+
+#include "types.h"
+#include "arena.h"
+#include "eval.h"
+#include "gc.h"
+#include "par.h"
+#include "stats.h"
+
+
+ /* structure definitions */
+
+typedef struct Deque Deque;
+typedef struct Stats Stats;
+
+struct Deque {
+	long         top;			/* next spark to steal */
+	long         bottom;			/* next free slot */
+	const Value *slot[PAR_SPARKS];
+	long         depth[PAR_SPARKS];		/* of each spark */
+};
+
+struct Stats {
+	unsigned long nsparks;			/* sparks made */
+	unsigned long ndropped;			/* queue was full */
+	unsigned long nfizzled;			/* evaluated meanwhile */
+	unsigned long nspeculated;		/* forced by a worker */
+	unsigned long nabandoned;		/* given up */
+};
+
+
+ /* static data */
+
+int  par_threads   = 0;
+bool par_sparking  = false;
+long par_quiescing = 0;
+
+static THREAD_LOCAL int  self  = 0;
+static THREAD_LOCAL long depth = 0;		/* of the spark being forced */
+
+static Deque *sparks  = 0;			/* one queue per thread */
+static const Value *kept[PAR_SPARKS];		/* used by sweep_par() */
+static long         kept_depth[PAR_SPARKS];
+static Stats *stats   = 0;
+static long   nbusy   = 0;			/* workers not idle */
+
+static Mutex  started_lock = MUTEX_INITIALIZER;
+static Cond   started_cond = COND_INITIALIZER;
+static int    nstarted     = 0;
+
+static bool   batch    = false;			/* see par_batch() */
+static Job    job      = 0;			/* guarded by started_lock */
+static long   njobs    = 0;
+static long   next_job = 0;
+static int    nworking = 0;			/* workers running jobs */
+
+
+#if defined(_WIN32)
+
+/* par_load_ptr - loads a pointer */
+
+void *par_load_ptr(void *volatile *p)
+{
+	void *v = *p;
+
+	_ReadWriteBarrier();
+	return v;
+}
+
+
+/* par_store_ptr - stores a pointer */
+
+void par_store_ptr(void *volatile *p, void *v)
+{
+	_ReadWriteBarrier();
+	*p = v;
+}
+
+
+/* par_cas_ptr - replaces a pointer if it is old */
+
+bool par_cas_ptr(void *volatile *p, void *old, void *new)
+{
+	return InterlockedCompareExchangePointer(p, new, old) == old;
+}
+
+
+/* par_load_int - loads a long */
+
+long par_load_int(volatile long *p)
+{
+	long v = *p;
+
+	_ReadWriteBarrier();
+	return v;
+}
+
+
+/* par_store_int - stores a long */
+
+void par_store_int(volatile long *p, long v)
+{
+	_ReadWriteBarrier();
+	*p = v;
+}
+
+
+/* par_cas_int - replaces a long if it is old */
+
+bool par_cas_int(volatile long *p, long old, long new)
+{
+	return InterlockedCompareExchange(p, new, old) == old;
+}
+
+
+/* par_lock - locks a mutex */
+
+void par_lock(Mutex *mtx)
+{
+	if (par_threads > 0) {
+		AcquireSRWLockExclusive(mtx);
+	}
+}
+
+
+/* par_unlock - unlocks a mutex */
+
+void par_unlock(Mutex *mtx)
+{
+	if (par_threads > 0) {
+		ReleaseSRWLockExclusive(mtx);
+	}
+}
+
+
+/* par_wait - waits for a condition */
+
+void par_wait(Cond *cond, Mutex *mtx)
+{
+	SleepConditionVariableSRW(cond, mtx, INFINITE, 0);
+}
+
+
+/* par_broadcast - wakes every thread waiting for a condition */
+
+void par_broadcast(Cond *cond)
+{
+	WakeAllConditionVariable(cond);
+}
+
+
+/* par_pause - backs off */
+
+void par_pause(int n)
+{
+	if (n < 64) {
+		SwitchToThread();
+	} else {
+		Sleep(1);
+	}
+}
+
+#else
+
+/* par_cas_ptr - replaces a pointer if it is old */
+
+bool par_cas_ptr(void **p, void *old, void *new)
+{
+	return __atomic_compare_exchange_n(p, &old, new, false,
+		__ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+
+/* par_cas_int - replaces a long if it is old */
+
+bool par_cas_int(long *p, long old, long new)
+{
+	return __atomic_compare_exchange_n(p, &old, new, false,
+		__ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+
+/* par_lock - locks a mutex */
+
+void par_lock(Mutex *mtx)
+{
+	if (par_threads > 0) {
+		pthread_mutex_lock(mtx);
+	}
+}
+
+
+/* par_unlock - unlocks a mutex */
+
+void par_unlock(Mutex *mtx)
+{
+	if (par_threads > 0) {
+		pthread_mutex_unlock(mtx);
+	}
+}
+
+
+/* par_wait - waits for a condition */
+
+void par_wait(Cond *cond, Mutex *mtx)
+{
+	pthread_cond_wait(cond, mtx);
+}
+
+
+/* par_broadcast - wakes every thread waiting for a condition */
+
+void par_broadcast(Cond *cond)
+{
+	pthread_cond_broadcast(cond);
+}
+
+
+/* par_pause - backs off */
+
+void par_pause(int n)
+{
+	struct timespec ts = { 0, 100 * 1000 };
+
+	if (n < 64) {
+		sched_yield();
+	} else {
+		nanosleep(&ts, 0);
+	}
+}
+
+#endif
+
+
+/* add - adds to a long atomically, and returns its old value */
+
+static long add(long *p, long n)
+{
+	long v;
+
+	do {
+		v = LOAD_INT(p);
+	} while (!CAS_INT(p, v, v + n));
+
+	return v;
+}
+
+
+/* par_self - returns the number of the calling thread */
+
+int par_self(void)
+{
+	return self;
+}
+
+
+/* par_spark - offers a thunk for speculative evaluation */
+
+void par_spark(const Value *val)
+{
+	Deque *dq = &sparks[self];
+	long   b  = dq->bottom;
+
+	if (depth >= PAR_DEPTH) {
+		return;
+	}
+	++stats[self].nsparks;
+	if (b - LOAD_INT(&dq->top) >= PAR_SPARKS) {
+		++stats[self].ndropped;
+		return;
+	}
+	STORE_PTR(&dq->slot[b & (PAR_SPARKS - 1)], val);
+	STORE_INT(&dq->depth[b & (PAR_SPARKS - 1)], depth);
+	STORE_INT(&dq->bottom, b + 1);
+}
+
+
+/* take - takes the oldest spark of a queue and its depth, or returns
+   0 */
+
+static const Value *take(Deque *dq, long *d)
+{
+	const Value *val = 0;
+	long         t;
+
+	do {
+		t = LOAD_INT(&dq->top);
+		if (t >= LOAD_INT(&dq->bottom)) {
+			return 0;
+		}
+		val = LOAD_PTR(&dq->slot[t & (PAR_SPARKS - 1)]);
+		*d  = LOAD_INT(&dq->depth[t & (PAR_SPARKS - 1)]);
+	} while (!CAS_INT(&dq->top, t, t + 1));
+
+	return val;
+}
+
+
+/* fizzled - tests whether a spark was evaluated, or taken for
+   evaluation, since it was made */
+
+static bool fizzled(const Value *val)
+{
+	const Thunk *thk = val->data.thunk;
+
+	return LOAD_PTR(&thk->value) != 0 || LOAD_PTR(&thk->exp) == 0;
+}
+
+
+/* steal - takes a spark worth evaluating from any thread, and sets
+   the depth of speculation for it */
+
+static const Value *steal(void)
+{
+	const Value *val = 0;
+	Deque       *dq = 0;
+	long         d = 0;
+	int          i;
+
+	for (i = 1; i <= par_threads + 1; i++) {
+		dq = &sparks[(self + i) % (par_threads + 1)];
+		while ((val = take(dq, &d)) != 0) {
+			if (!fizzled(val)) {
+				depth = d + 1;
+				return val;
+			}
+			++stats[self].nfizzled;
+		}
+	}
+
+	return 0;
+}
+
+
+/* attach - registers the calling thread with the other modules */
+
+static void attach(int id)
+{
+	self = id;
+	eval_attach();
+	gc_attach();
+	arena_attach();
+	stats_attach();
+}
+
+
+/* run_jobs - runs jobs until none is left */
+
+static void run_jobs(void)
+{
+	long i;
+
+	while ((i = add(&next_job, 1)) < njobs) {
+		job(i);
+	}
+}
+
+
+/* work - the main loop of a worker thread */
+
+static void work(int id)
+{
+	const Value *val = 0;
+	int          idle = 0;
+
+	attach(id);
+	par_lock(&started_lock);
+	++nstarted;
+	par_broadcast(&started_cond);
+	par_unlock(&started_lock);
+
+	if (batch) {
+		par_lock(&started_lock);
+		while (job == 0) {
+			par_wait(&started_cond, &started_lock);
+		}
+		par_unlock(&started_lock);
+
+		gc_unpark();
+		run_jobs();
+		gc_park();
+
+		/* stay, as the reports read the counts of every thread */
+		par_lock(&started_lock);
+		--nworking;
+		par_broadcast(&started_cond);
+		for (;;) {
+			par_wait(&started_cond, &started_lock);
+		}
+	}
+
+	for (;;) {
+		add(&nbusy, 1);
+		val = 0;
+		if (!LOAD_INT(&par_quiescing)) {
+			gc_unpark();
+			if ((val = steal()) != 0) {
+				++stats[self].nspeculated;
+				if (!speculate(val)) {
+					++stats[self].nabandoned;
+				}
+			}
+			gc_park();
+		}
+		add(&nbusy, -1);
+		idle = val != 0 ? 0 : idle + 1;
+		if (idle > 0) {
+			par_pause(idle);
+		}
+	}
+}
+
+
+#if defined(_WIN32)
+
+static DWORD WINAPI worker(LPVOID arg)
+{
+	work((int)(intptr_t)arg);
+	return 0;
+}
+
+
+/* spawn - starts a worker thread */
+
+static bool spawn(int id)
+{
+	HANDLE thr = CreateThread(0, 0, worker, (LPVOID)(intptr_t)id, 0, 0);
+
+	if (thr == 0) {
+		return false;
+	}
+	CloseHandle(thr);
+	return true;
+}
+
+#else
+
+static void *worker(void *arg)
+{
+	work((int)(intptr_t)arg);
+	return 0;
+}
+
+
+/* spawn - starts a worker thread */
+
+static bool spawn(int id)
+{
+	pthread_t thr;
+
+	if (pthread_create(&thr, 0, worker, (void *)(intptr_t)id) != 0) {
+		return false;
+	}
+	pthread_detach(thr);
+	return true;
+}
+
+#endif
+
+
+/* start - starts n worker threads */
+
+static void start(int n)
+{
+	int i;
+
+	assert(0 <= n && n < PAR_MAX_THREADS);
+
+	par_threads = n;
+	nworking    = n;
+	sparks = (Deque *)calloc(n + 1, sizeof(*sparks));
+	stats  = (Stats *)calloc(n + 1, sizeof(*stats));
+	assert(sparks != 0 && stats != 0);
+
+	attach(0);
+	for (i = 1; i <= n; i++) {
+		if (!spawn(i)) {
+			fwprintf(stderr, L"%s: cannot start thread %d\n",
+				"par_start", i);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	par_lock(&started_lock);
+	while (nstarted < n) {
+		par_wait(&started_cond, &started_lock);
+	}
+	par_unlock(&started_lock);
+}
+
+
+/* par_start - starts the worker threads for speculation */
+
+void par_start(int n)
+{
+	par_sparking = n > 0;
+	start(n);
+}
+
+
+/* par_batch - starts the worker threads for jobs */
+
+void par_batch(int n)
+{
+	assert(0 < n && n <= PAR_MAX_THREADS);
+
+	batch = true;
+	start(n - 1);
+}
+
+
+/* par_run - runs jobs on the main thread and the workers */
+
+void par_run(long count, Job fn)
+{
+	assert(batch && job == 0);
+
+	par_lock(&started_lock);
+	njobs = count;
+	job   = fn;
+	par_broadcast(&started_cond);
+	par_unlock(&started_lock);
+
+	run_jobs();
+
+	gc_park();
+	par_lock(&started_lock);
+	while (nworking > 0) {
+		par_wait(&started_cond, &started_lock);
+	}
+	par_unlock(&started_lock);
+	gc_unpark();
+}
+
+
+/* par_quiesce - stops speculation, and waits until the workers are
+   idle */
+
+void par_quiesce(void)
+{
+	int i;
+
+	if (!par_sparking) {
+		return;
+	}
+
+	CAS_INT(&par_quiescing, 0, 1);
+	gc_park();
+	for (i = 0; LOAD_INT(&nbusy) > 0; i++) {
+		par_pause(i);
+	}
+	gc_unpark();
+
+	for (i = 0; i <= par_threads; i++) {
+		STORE_INT(&sparks[i].top, LOAD_INT(&sparks[i].bottom));
+	}
+	STORE_INT(&par_quiescing, 0);
+}
+
+
+/* sweep_par - drops the sparks that are garbage or fizzled */
+
+void sweep_par(void)
+{
+	Deque       *dq = 0;
+	const Value *val = 0;
+	long         t, n, d;
+
+	for (dq = sparks; dq < sparks + par_threads + 1; dq++) {
+		n = 0;
+		for (t = dq->top; t < dq->bottom; t++) {
+			val = dq->slot[t & (PAR_SPARKS - 1)];
+			d   = dq->depth[t & (PAR_SPARKS - 1)];
+			if (arena_marked(val) && !fizzled(val)) {
+				kept[n] = val;
+				kept_depth[n++] = d;
+			}
+		}
+		memcpy(dq->slot, kept, n * sizeof(*kept));
+		memcpy(dq->depth, kept_depth, n * sizeof(*kept_depth));
+		dq->top    = 0;
+		dq->bottom = n;
+	}
+}
+
+
+/* par_report - reports spark counts */
+
+void par_report(FILE *stream)
+{
+	Stats sum = { 0, 0, 0, 0, 0 };
+	int   i;
+
+	for (i = 0; i <= par_threads; i++) {
+		sum.nsparks     += stats[i].nsparks;
+		sum.ndropped    += stats[i].ndropped;
+		sum.nfizzled    += stats[i].nfizzled;
+		sum.nspeculated += stats[i].nspeculated;
+		sum.nabandoned  += stats[i].nabandoned;
+	}
+	fwprintf(stream, L";; %d threads, %lu sparks, %lu dropped,"
+		L" %lu fizzled, %lu speculated, %lu given up\n",
+		par_threads, sum.nsparks, sum.ndropped, sum.nfizzled,
+		sum.nspeculated, sum.nabandoned);
+}
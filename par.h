@@ -0,0 +1,97 @@
+#ifndef _PAR_H_INCLUDED_
+#define _PAR_H_INCLUDED_
+#include <stdio.h>
+#include "types.h"
+/*++
+/* NAME
+/*	par 3h
+/* SUMMARY
+/*	Speculative parallel evaluation.
+/* DESCRIPTION
+/* .nf
+
+ /* constants */
+
+#define PAR_MAX_THREADS	(64)		/* including the main thread */
+#define PAR_SPARKS	(4096)		/* sparks per thread, a power of 2 */
+#define PAR_DEPTH	(6)		/* of nested speculation */
+
+
+ /* threads, locks and atomic operations */
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+#define THREAD_LOCAL		__declspec(thread)
+
+typedef SRWLOCK			Mutex;
+typedef CONDITION_VARIABLE	Cond;
+
+#define MUTEX_INITIALIZER	SRWLOCK_INIT
+#define COND_INITIALIZER	CONDITION_VARIABLE_INIT
+
+#define LOAD_PTR(p)		par_load_ptr((void *volatile *)(p))
+#define STORE_PTR(p, v)		par_store_ptr((void *volatile *)(p), (void *)(v))
+#define CAS_PTR(p, o, n)	par_cas_ptr((void *volatile *)(p), \
+					(void *)(o), (void *)(n))
+#define LOAD_INT(p)		par_load_int((volatile long *)(p))
+#define STORE_INT(p, v)		par_store_int((volatile long *)(p), (v))
+#define CAS_INT(p, o, n)	par_cas_int((volatile long *)(p), (o), (n))
+
+void	*par_load_ptr(void *volatile *p);
+void	 par_store_ptr(void *volatile *p, void *v);
+bool	 par_cas_ptr(void *volatile *p, void *old, void *new);
+long	 par_load_int(volatile long *p);
+void	 par_store_int(volatile long *p, long v);
+bool	 par_cas_int(volatile long *p, long old, long new);
+#else
+#include <pthread.h>
+
+#define THREAD_LOCAL		__thread
+
+typedef pthread_mutex_t		Mutex;
+typedef pthread_cond_t		Cond;
+
+#define MUTEX_INITIALIZER	PTHREAD_MUTEX_INITIALIZER
+#define COND_INITIALIZER	PTHREAD_COND_INITIALIZER
+
+#define LOAD_PTR(p)		__atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define STORE_PTR(p, v)		__atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define CAS_PTR(p, o, n)	par_cas_ptr((void **)(p), (void *)(o), \
+					(void *)(n))
+#define LOAD_INT(p)		__atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define STORE_INT(p, v)		__atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define CAS_INT(p, o, n)	par_cas_int((long *)(p), (o), (n))
+
+bool	 par_cas_ptr(void **p, void *old, void *new);
+bool	 par_cas_int(long *p, long old, long new);
+#endif
+
+
+ /* Function prototypes */
+
+typedef void (*Job)(long i);
+
+void	 par_start(int n);
+void	 par_batch(int n);
+void	 par_run(long njobs, Job job);
+void	 par_spark(const Value *val);
+void	 par_quiesce(void);
+int	 par_self(void);
+void	 par_lock(Mutex *mtx);
+void	 par_unlock(Mutex *mtx);
+void	 par_wait(Cond *cond, Mutex *mtx);
+void	 par_broadcast(Cond *cond);
+void	 par_pause(int n);
+void	 sweep_par(void);
+void	 par_report(FILE *stream);
+
+extern int  par_threads;
+extern bool par_sparking;
+extern long par_quiescing;
+
+/* AUTHOR
+/*	Brent Harp
+/*--*/
+#endif
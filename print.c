@@ -29,6 +29,7 @@
 #include "eval.h"
 #include "char.h"
 #include "env.h"
+#include "exp.h"
 
 
 
@@ -68,6 +69,10 @@ void print_value(const Value * val, FILE *stream)
 		print_thunk(val->data.thunk, stream);
 		break;
 
+	case T_Num:
+		fwprintf(stream, L"%llu", val->data.num);
+		break;
+
 	default:
 		fwprintf(stderr, L"%s: %d: %s: Unknown value type: %d\n",
 			__FILE__, __LINE__, "print_value", val->type);
@@ -103,6 +108,8 @@ void print_exp(const Exp *exp, FILE *stream)
 
 	switch (exp->type) {
 	case T_Exp_Symbol:
+	case T_Exp_Local:
+	case T_Exp_Global:
 		fputws(exp->sval, stream);
 		break;
 
@@ -140,7 +147,7 @@ void print_exp(const Exp *exp, FILE *stream)
 		break;
 
 	case T_Exp_Num:
-		fwprintf(stream, L"%d", exp->nval);
+		fwprintf(stream, L"%llu", exp->num);
 		break;
 
 	default:
@@ -158,12 +165,16 @@ static wchar_t *type_name[] = {
     L"T_Exp_Lambda",
     L"T_Exp_Pair",
     L"T_Exp_Quote",
-    L"T_Exp_Assign"
+    L"T_Exp_Assign",
+    L"T_Exp_Seq",
+    L"T_Exp_Num",
+    L"T_Exp_Local",
+    L"T_Exp_Global"
 };
 
 int indent(int delta, FILE *stream)
 {
-	static int indent = 0;
+	static THREAD_LOCAL int indent = 0;
 	int i;
 
 	fputwc(L'\n', stream);
@@ -188,15 +199,16 @@ void dump_exp(const Exp * exp, FILE *stream)
     fputws(L"\n", stream);
     indent(0, stream);
     fputws(L"sval: ", stream);
-    fputws(exp->sval != 0 ? exp->sval : L"(null)", stream);
+    fputws(exp_arity(exp) == 0 && exp->type != T_Exp_Num
+	? exp->sval : L"(null)", stream);
     fputws(L"\n", stream);
     indent(0, stream);
     fputws(L"child: [\n", stream);
     indent(1, stream);
-    dump_exp(exp->child[0], stream);
+    dump_exp(exp_arity(exp) > 0 ? exp->child[0] : 0, stream);
     fputws(L",\n", stream);
     indent(0, stream);
-    dump_exp(exp->child[1], stream);
+    dump_exp(exp_arity(exp) > 1 ? exp->child[1] : 0, stream);
     fputws(L"\n", stream);
     indent(-1, stream);
     fputws(L"]\n", stream);
@@ -0,0 +1,305 @@
+/*++
+/* NAME
+/*	profile 3
+/* SUMMARY
+/*	Sampling profiler of named functions.
+/* SYNOPSIS
+/*	#include <profile.h>
+/*
+/*	void	profile_start(path);
+/*	const char *path;
+/*
+/*	void	profile_enter(name, depth);
+/*	Symbol	name;
+/*	int	depth;
+/*
+/*	void	profile_leave(depth);
+/*	int	depth;
+/*
+/*	void	profile_keep();
+/*
+/*	Symbol	profile_top();
+/*
+/*	bool	profiling;
+/* DESCRIPTION
+/*	The profiler attributes the CPU time of a run to the named
+/*	functions, those bound by bind() in env(3), that are being
+/*	applied when it is spent.
+/*
+/*	profile_start() opens the file at path, sets profiling, and
+/*	starts a timer that samples the shadow stack PROFILE_HZ times a
+/*	second of CPU time. The profile is written to the file when the
+/*	program exits.
+/*
+/*	The shadow stack holds a frame for each named function under
+/*	application, with the depth of the continuation stack of eval(3)
+/*	it was applied at. profile_enter() pushes a frame when a named
+/*	function is applied at depth. A frame at the same or a greater
+/*	depth belongs to a function whose application has ended, or is
+/*	replaced by a tail call, and is popped first. profile_leave()
+/*	pops those frames when evaluation returns to a continuation at
+/*	depth. A shadow stack of more than PROFILE_FRAMES frames is not
+/*	pushed on further, so the innermost frames of very deep
+/*	recursion are not seen.
+/*
+/*	profiling is set while the shadow stack is kept: by
+/*	profile_start(), or by profile_keep(), which keeps it without
+/*	sampling, for the heap profiler of heap(3) and the tracer of
+/*	trace(3). When tracing, each frame popped is recorded as a span
+/*	with trace_span(). profile_top() returns
+/*	the name of the innermost frame, or 0 outside of any named
+/*	function.
+/*
+/*	A sample counts the innermost PROFILE_DEPTH frames of the shadow
+/*	stack in a table of PROFILE_STACKS distinct stacks, which is
+/*	allocated up front, as the signal handler that takes it may not
+/*	allocate. Samples of new stacks that do not fit are dropped.
+/*
+/*	The profile is written in the collapsed stack format of the
+/*	flame graph tools: one line per stack, with the names of its
+/*	frames from the outermost, separated by semicolons, and the
+/*	number of samples. Samples taken outside of any named function
+/*	are counted as (top level), and a truncated stack starts with
+/*	"...".
+/* DIAGNOSTICS
+/*	Failing to open the profile, or to start the timer, is a fatal
+/*	error. The number of samples, and of samples dropped, is
+/*	reported on stderr at exit.
+/* BUGS
+/*	The timer signal is delivered to the process, so the profiler
+/*	works on a single thread only. It needs ITIMER_PROF and is not
+/*	available on Windows.
+/*--*/
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#if !defined(_WIN32)
+#include <signal.h>
+#include <sys/time.h>
+#endif
+
+#include "types.h"
+#include "profile.h"
+#include "trace.h"
+
+
+ /* structure definitions */
+
+typedef struct Frame {
+	Symbol name;
+	int    depth;		/* of the continuation stack */
+	double start;		/* see trace(3) */
+} Frame;
+
+typedef struct Stack {
+	unsigned long hash;
+	unsigned long count;	/* samples; 0 for a free entry */
+	int           n;	/* frames */
+	bool          truncated;
+	Symbol       *names;	/* PROFILE_DEPTH of them */
+} Stack;
+
+
+ /* static data */
+
+bool profiling = false;
+
+static FILE                  *out      = 0;
+static const char            *out_path = 0;
+static volatile Frame        *frames   = 0;	/* the shadow stack */
+static volatile int           height   = 0;
+static Stack                 *stacks   = 0;
+static volatile unsigned long nsamples = 0;
+static volatile unsigned long ndropped = 0;
+static int                    nstacks  = 0;
+
+
+#if !defined(_WIN32)
+
+/* sample - counts the shadow stack; called on the timer signal */
+
+static void sample(int sig)
+{
+	int n = height;
+	int lo = n > PROFILE_DEPTH ? n - PROFILE_DEPTH : 0;
+	unsigned long h = 2166136261UL;		/* FNV-1a */
+	Stack *s = 0;
+	int i, j;
+
+	(void)sig;
+	++nsamples;
+
+	for (i = lo; i < n; i++) {
+		h = (h ^ (unsigned long)(uintptr_t)frames[i].name) * 16777619UL;
+	}
+	h ^= (unsigned long)lo;
+
+	for (i = h & (PROFILE_STACKS - 1); ; i = (i + 1) & (PROFILE_STACKS - 1)) {
+		s = &stacks[i];
+		if (s->count == 0) {
+			break;
+		}
+		if (s->hash != h || s->n != n - lo || s->truncated != (lo > 0)) {
+			continue;
+		}
+		for (j = 0; j < s->n && s->names[j] == frames[lo + j].name; j++) {
+			;
+		}
+		if (j == s->n) {
+			++s->count;
+			return;
+		}
+	}
+
+	/* a new stack; keep the table at most 3/4 full */
+	if (4 * (nstacks + 1) > 3 * PROFILE_STACKS) {
+		++ndropped;
+		return;
+	}
+	s->hash      = h;
+	s->n         = n - lo;
+	s->truncated = lo > 0;
+	for (j = 0; j < s->n; j++) {
+		s->names[j] = frames[lo + j].name;
+	}
+	s->count = 1;
+	++nstacks;
+}
+
+#endif
+
+
+/* write_profile - stops sampling and writes the profile; called at
+   exit */
+
+static void write_profile(void)
+{
+	const Stack *s = 0;
+	int i, j;
+#if !defined(_WIN32)
+	struct itimerval off = { { 0, 0 }, { 0, 0 } };
+
+	setitimer(ITIMER_PROF, &off, 0);
+#endif
+	profiling = false;
+
+	for (i = 0; i < PROFILE_STACKS; i++) {
+		s = &stacks[i];
+		if (s->count == 0) {
+			continue;
+		}
+		if (s->truncated) {
+			fputws(L"...;", out);
+		} else if (s->n == 0) {
+			fputws(L"(top level)", out);
+		}
+		for (j = 0; j < s->n; j++) {
+			fputws(s->names[j], out);
+			if (j + 1 < s->n) {
+				fputwc(L';', out);
+			}
+		}
+		fwprintf(out, L" %lu\n", s->count);
+	}
+	fclose(out);
+
+	fwprintf(stderr, L";; %lu samples, %lu dropped, written to %s\n",
+		nsamples, ndropped, out_path);
+}
+
+
+/* profile_start - starts sampling into the profile at path */
+
+void profile_start(const char *path)
+{
+#if defined(_WIN32)
+	fwprintf(stderr, L"%s: not available on this system\n", "profile");
+	exit(EXIT_FAILURE);
+#else
+	struct sigaction sa;
+	struct itimerval every;
+	Symbol *names = 0;
+	int i;
+
+	if ((out = fopen(path, "w")) == 0) {
+		fwprintf(stderr, L"%s: cannot open %s\n", "profile", path);
+		exit(EXIT_FAILURE);
+	}
+	out_path = path;
+
+	profile_keep();
+	stacks = calloc(PROFILE_STACKS, sizeof(*stacks));
+	names  = calloc((size_t)PROFILE_STACKS * PROFILE_DEPTH,
+		sizeof(*names));
+	assert(stacks != 0 && names != 0);
+	for (i = 0; i < PROFILE_STACKS; i++) {
+		stacks[i].names = names + (size_t)i * PROFILE_DEPTH;
+	}
+
+	sa.sa_handler = sample;
+	sa.sa_flags   = SA_RESTART;
+	sigemptyset(&sa.sa_mask);
+	every.it_interval.tv_sec  = 0;
+	every.it_interval.tv_usec = 1000000 / PROFILE_HZ;
+	every.it_value = every.it_interval;
+	if (sigaction(SIGPROF, &sa, 0) != 0
+	    || setitimer(ITIMER_PROF, &every, 0) != 0) {
+		fwprintf(stderr, L"%s: cannot start the timer\n", "profile");
+		exit(EXIT_FAILURE);
+	}
+
+	atexit(write_profile);
+#endif
+}
+
+
+/* profile_keep - keeps the shadow stack, without sampling it */
+
+void profile_keep(void)
+{
+	if (frames == 0) {
+		frames = calloc(PROFILE_FRAMES, sizeof(*frames));
+		assert(frames != 0);
+	}
+	profiling = true;
+}
+
+
+/* profile_top - returns the name of the innermost frame */
+
+Symbol profile_top(void)
+{
+	return height > 0 ? frames[height - 1].name : 0;
+}
+
+
+/* profile_enter - pushes a frame for a named function applied at
+   depth */
+
+void profile_enter(Symbol name, int depth)
+{
+	profile_leave(depth);
+	if (height < PROFILE_FRAMES) {
+		frames[height].name  = name;
+		frames[height].depth = depth;
+		frames[height].start = tracing ? trace_now() : 0;
+		++height;
+	}
+}
+
+
+/* profile_leave - pops the frames of functions whose application has
+   ended, as evaluation returns to depth */
+
+void profile_leave(int depth)
+{
+	while (height > 0 && frames[height - 1].depth >= depth) {
+		--height;
+		if (tracing) {
+			trace_span(TR_Function, frames[height].name, 0,
+				frames[height].start);
+		}
+	}
+}
@@ -0,0 +1,33 @@
+#ifndef _PROFILE_H_INCLUDED_
+#define _PROFILE_H_INCLUDED_
+#include "types.h"
+/*++
+/* NAME
+/*	profile 3h
+/* SUMMARY
+/*	Sampling profiler of named functions.
+/* DESCRIPTION
+/* .nf
+
+ /* constants */
+
+#define PROFILE_HZ	(1000)		/* samples per second of CPU time */
+#define PROFILE_FRAMES	(64 * 1024)	/* named frames on the shadow stack */
+#define PROFILE_DEPTH	(64)		/* innermost frames of a sample */
+#define PROFILE_STACKS	(16 * 1024)	/* distinct stacks, a power of 2 */
+
+
+ /* Function prototypes */
+
+void	 profile_start(const char *path);
+void	 profile_enter(Symbol name, int depth);
+void	 profile_leave(int depth);
+void	 profile_keep(void);
+Symbol	 profile_top(void);
+
+extern bool profiling;
+
+/* AUTHOR
+/*	Brent Harp
+/*--*/
+#endif
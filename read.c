@@ -5,306 +5,692 @@
 /*	expression reader
 /* SYNOPSIS
 /*	#include <read.h>
-/*	
-/*	Exp	*read(void);
+/*
+/*	Reader	*reader_open(FILE *stream);
+/*
+/*	void	reader_close(Reader *rd);
+/*
+/*	const Exp *read_statement(Reader *rd);
+/*
+/*	const Exp *read_exp(Reader *rd);
+/*
+/*	void	read_report(FILE *stream);
+/*
+/*	bool	read_stats;
 /* DESCRIPTION
 /*  Reads sentences in the following grammar:
 /*  statement : ( assignment | expression-sequence ) "."
 /*  assignment : symbol "=" expression-sequence
 /*  expression-sequence : expression-list "," expression-sequence | expression-list
 /*  expression-list : ( expression expression-list ) | expression
+/*
+/*  reader_open() makes a reader of the source text of an open stream,
+/*  and reader_close() frees it; the caller still closes the stream.
+/*  read_statement() returns the next statement, or 0 at the end of
+/*  the text.
+/*
+/*  The reader works on the bytes of the text, not on wide characters.
+/*  Symbols and numbers are ASCII, and a comment, from `;' to the end
+/*  of the line, may hold any UTF-8 text. A regular file is mapped
+/*  into memory whole where the system allows it. Other streams, such
+/*  as stdin, are read into a buffer with the system call read(),
+/*  which returns what is there to read rather than waiting to fill
+/*  the buffer, so the REPL reads a statement as soon as it is typed.
+/*  The buffer grows to hold a token that does not fit in it.
+/*
+/*  Runs of white space and of symbol characters are scanned 16 bytes
+/*  at a time with SSE2 where the compiler targets it, and comments
+/*  are skipped with memchr(). The parser looks one token ahead.
+/*
+/*  When read_stats is set, read_statement() keeps the processor time
+/*  it takes, and read_report() writes the number of bytes read and
+/*  the rate at which they were parsed to stream.
+/* DIAGNOSTICS
+/*  Syntax errors are reported on stderr, and are errors (see fail()
+/*  in eval(3)). So is an assignment to anything but a symbol, which
+/*  is reported once the whole statement has been read, a number too
+/*  large for a native number (see num(3)), and an empty right-hand
+/*  side of '=' or ',', body of a lambda, or quotation. After a syntax
+/*  error the reader skips to the end of the statement, the next `.',
+/*  so that one error is reported for it.
 /*--*/
 
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
-#include <search.h>
 #include <string.h>
 #include <assert.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#if defined(_WIN32)
+#include <io.h>
+#define read	_read
+#define fileno	_fileno
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64) \
+    || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define READ_SSE2
+#endif
 
 #include "read.h"
+#include "eval.h"
 #include "exp.h"
 #include "char.h"
 #include "num.h"
+#include "par.h"
+#include "symbol.h"
 
  /* key words */
 
 static const wchar_t *print = L"print";
 
+ /* constants */
+
+#define MAX_SYMBOL_LENGTH (64)
+#define READ_BUFFER	(64 * 1024)	/* initial buffer size */
+
+ /* structure definitions */
+
+enum Lexeme {
+	L_Symbol,
+	L_Num,
+	L_Lambda,
+	L_Quote,
+	L_LParen,
+	L_RParen,
+	L_Dot,
+	L_Assign,
+	L_Comma,
+	L_Other,		/* any other character */
+	L_EOF
+};
+
+typedef struct Token Token;
+
+struct Token {
+	enum Lexeme  kind;
+	wint_t       ch;	/* first character, or WEOF */
+	Symbol       sym;	/* L_Symbol */
+	Number       num;	/* L_Num */
+	bool         big;	/* L_Num: more than NUMBER_MAX */
+};
+
+struct Reader {
+	FILE                *stream;
+	const unsigned char *p;		/* next byte */
+	const unsigned char *end;	/* end of the bytes read so far */
+	unsigned char       *buf;	/* the bytes, unless mapped */
+	size_t               size;
+	void                *map;	/* the mapped file */
+	size_t               maplen;
+	bool                 eof;	/* no bytes follow end */
+	bool                 peeked;	/* tok is the next token */
+	Token                tok;
+	unsigned long        nbytes;	/* bytes read */
+	clock_t              elapsed;	/* in read_statement() */
+};
+
+ /* static data */
+
+bool read_stats = false;
+
+static unsigned long nread   = 0;	/* bytes read by closed readers */
+static clock_t       reading = 0;	/* time they took */
+static Mutex         lock    = MUTEX_INITIALIZER;	/* guards the above */
+
  /* function prototypes */
 
-static const Exp *read_exp_list(FILE *);
-static const Exp *read_exp_list_delim(wint_t, FILE *);
-static const Exp *read_sub_exp(FILE *);
-static const Exp *read_quote_exp(FILE *);
-static const Exp *read_lambda_exp(FILE *);
-static const Exp *read_symbol_exp(FILE *);
-static const Exp *read_num_exp(FILE *);
-static const Exp *read_exp_sequence(FILE *);
-static void read_dot(FILE *);
-static wint_t read_char(FILE *, bool);
-static void unread_char(wint_t, FILE *);
-static const Exp *parse_error(const wchar_t *, ...);
-static wint_t get_char(FILE *);
-
-
-const Exp *read_statement(FILE * stream)
-{
-	const Exp *stmt = 0, *lhs, *rhs;
-	wchar_t    ch;
+static const Exp *read_exp_list(Reader *);
+static const Exp *read_exp_list_delim(wint_t, Reader *);
+static const Exp *read_sub_exp(Reader *);
+static const Exp *read_quote_exp(Reader *);
+static const Exp *read_lambda_exp(Reader *);
+static const Exp *read_exp_sequence(Reader *);
+static void read_dot(Reader *);
+static const Exp *expected(const wchar_t *, Reader *);
+static Token peek(Reader *);
+static Token next(Reader *);
+static const Exp *parse_error(Reader *, const wchar_t *, ...);
 
-	if ((lhs = read_exp_list(stream)) != 0) {
 
-		/* Peek at next char. */
-		ch = read_char(stream, true);
+/* reader_open - makes a reader of a stream */
 
-		if (ch == L'=') { /* Assignment. */
-			rhs  = read_exp_sequence(stream);
-			stmt = make_assign_exp(lhs, rhs);
-		} else if (ch == L',') { /* Sequence. */
-			rhs  = read_exp_sequence(stream);
-			stmt = make_seq_exp(lhs, rhs);
-		} else if (ch != WEOF) { /* Simple list. */
-			unread_char(ch, stream);
-			stmt = lhs;
+Reader *reader_open(FILE *stream)
+{
+	Reader *rd = calloc(1, sizeof(*rd));
+#if !defined(_WIN32)
+	struct stat st;
+#endif
+
+	assert(rd != 0);
+	rd->stream = stream;
+
+#if !defined(_WIN32)
+	if (fstat(fileno(stream), &st) == 0 && S_ISREG(st.st_mode)
+	    && ftell(stream) == 0) {
+		rd->maplen = (size_t)st.st_size;
+		rd->map = rd->maplen == 0 ? 0 : mmap(0, rd->maplen, PROT_READ,
+			MAP_PRIVATE, fileno(stream), 0);
+		if (rd->maplen == 0 || rd->map != MAP_FAILED) {
+			rd->p      = rd->map;
+			rd->end    = rd->p + rd->maplen;
+			rd->eof    = true;
+			rd->nbytes = rd->maplen;
+			return rd;
 		}
+		rd->map = 0;
+	}
+#endif
 
-		read_dot(stream);
+	rd->size = READ_BUFFER;
+	rd->buf  = malloc(rd->size);
+	assert(rd->buf != 0);
+	rd->p = rd->end = rd->buf;
+
+	return rd;
+}
+
+
+/* reader_close - frees a reader */
+
+void reader_close(Reader *rd)
+{
+#if !defined(_WIN32)
+	if (rd->map != 0) {
+		munmap(rd->map, rd->maplen);
 	}
-	
-	return stmt;
+#endif
+	par_lock(&lock);
+	nread   += rd->nbytes;
+	reading += rd->elapsed;
+	par_unlock(&lock);
+
+	free(rd->buf);
+	free(rd);
 }
 
 
-static const Exp *read_exp_sequence(FILE * stream)
+/* refill - reads more bytes into the buffer of a reader, keeping the
+   bytes from keep on; returns where they were moved to */
+
+static const unsigned char *refill(Reader *rd, const unsigned char *keep)
 {
-	const Exp *lst = 0, *seq = 0;
-	wint_t c = 0;
+	size_t n  = rd->end - keep;
+	size_t at = rd->p - keep;
+	int    got;
 
-	if ((seq = read_exp_list(stream)) == 0) {
-		return 0;
+	if (rd->eof) {
+		return keep;
 	}
 
-	while ((c = read_char(stream, true)) == L',') {
-		lst = read_exp_list(stream);
-		seq = make_seq_exp(seq, lst);
+	memmove(rd->buf, keep, n);
+	if (n == rd->size) {
+		rd->size *= 2;
+		rd->buf = realloc(rd->buf, rd->size);
+		assert(rd->buf != 0);
 	}
 
-	unread_char(c, stream);
+	got = read(fileno(rd->stream), rd->buf + n, (unsigned)(rd->size - n));
+	if (got <= 0) {
+		rd->eof = true;
+		got = 0;
+	}
+	rd->nbytes += got;
+	rd->p   = rd->buf + at;
+	rd->end = rd->buf + n + got;
 
-	return seq;
+	return rd->buf;
 }
 
 
-static const Exp *read_exp_list_delim(wint_t c, FILE * stream)
+/* first_bit - the number of the lowest bit set in a mask */
+
+static int first_bit(unsigned int m)
 {
-    const Exp *e = 0;
+#if defined(_MSC_VER)
+	unsigned long i;
+
+	_BitScanForward(&i, m);
+	return (int)i;
+#else
+	return __builtin_ctz(m);
+#endif
+}
 
-    e = read_exp_list(stream);
-    if (e != 0 && read_char(stream, false) != c) {
-		parse_error(L"expected '%c'", c);
-    }
 
-    return e;
+/* is_space - tests for a white space byte */
+
+static bool is_space(unsigned char c)
+{
+	return c == space || c == tab || c == newline || c == creturn;
 }
 
 
-static const Exp *read_exp_list(FILE * stream)
+/* is_alnum - tests for a byte of a symbol */
+
+static bool is_alnum(unsigned char c)
 {
-	const Exp *exp = 0, *lst = 0;
-	wint_t c = 0;
+	return ('a' <= (c | 0x20) && (c | 0x20) <= 'z')
+	    || ('0' <= c && c <= '9');
+}
 
-	if ((exp = read_exp(stream)) == 0) {
-		return 0;
-	}
 
-	for (lst = read_exp(stream); lst != 0; lst = read_exp(stream)) {
-		exp = make_pair_exp(exp, lst);
+/* span_space - skips white space */
+
+static const unsigned char *span_space(const unsigned char *p,
+				       const unsigned char *end)
+{
+#if defined(READ_SSE2)
+	__m128i v, ws;
+	unsigned int m;
+
+	for (; end - p >= 16; p += 16) {
+		v  = _mm_loadu_si128((const __m128i *)p);
+		ws = _mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+				     _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'))),
+			_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\t')),
+				     _mm_cmpeq_epi8(v, _mm_set1_epi8('\r'))));
+		if ((m = ~_mm_movemask_epi8(ws) & 0xffff) != 0) {
+			return p + first_bit(m);
+		}
+	}
+#endif
+	while (p < end && is_space(*p)) {
+		++p;
 	}
 
-	return exp;
+	return p;
 }
 
 
-const Exp *read_exp(FILE * stream)
+/* span_alnum - skips the characters of a symbol */
+
+static const unsigned char *span_alnum(const unsigned char *p,
+				       const unsigned char *end)
 {
-	wint_t c;
-
-	c = read_char(stream, true);
-
-	if (c == L'\\') {
-		return read_lambda_exp(stream);
-	} else if (c == L'\'') {
-		return read_quote_exp(stream);
-	} else if (c == L'(') {
-		return read_sub_exp(stream);
-	} else if (L'a' <= c && c <= L'z'
-		    || L'A' <= c && c <= L'Z') {
-		unread_char(c, stream);
-		return read_symbol_exp(stream);
-	} else if (L'0' <= c && c <= L'9') {
-		unread_char(c, stream);
-		return read_num_exp(stream);
-	} else {
-		/* invalid expression */
-		unread_char(c, stream);
-		return 0;
+#if defined(READ_SSE2)
+	__m128i v, l, in;
+	unsigned int m;
+
+	for (; end - p >= 16; p += 16) {
+		v  = _mm_loadu_si128((const __m128i *)p);
+		l  = _mm_or_si128(v, _mm_set1_epi8(0x20));
+		in = _mm_or_si128(
+			_mm_and_si128(_mm_cmpgt_epi8(l, _mm_set1_epi8('a' - 1)),
+				      _mm_cmplt_epi8(l, _mm_set1_epi8('z' + 1))),
+			_mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+				      _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1))));
+		if ((m = ~_mm_movemask_epi8(in) & 0xffff) != 0) {
+			return p + first_bit(m);
+		}
+	}
+#endif
+	while (p < end && is_alnum(*p)) {
+		++p;
 	}
+
+	return p;
 }
 
 
-static const Exp *read_sub_exp(FILE *stream)
+/* skip_space - skips white space and comments */
+
+static void skip_space(Reader *rd)
 {
-	return read_exp_list_delim(rparen, stream);
+	const unsigned char *nl = 0;
+	bool in_comment = false;
+
+	for (;;) {
+		if (in_comment) {
+			nl = memchr(rd->p, '\n', rd->end - rd->p);
+			rd->p = nl != 0 ? nl + 1 : rd->end;
+			in_comment = nl == 0;
+		}
+		if (!in_comment) {
+			rd->p = span_space(rd->p, rd->end);
+			if (rd->p < rd->end) {
+				if (*rd->p != comment) {
+					return;
+				}
+				in_comment = true;
+				continue;
+			}
+		}
+		if (rd->eof) {
+			return;
+		}
+		refill(rd, rd->p);
+	}
 }
 
 
-static const Exp *read_quote_exp(FILE *stream)
+/* lex_word - reads the symbol or number at the next byte */
+
+static void lex_word(Reader *rd, Token *t)
 {
-	return make_quote_exp(read_exp(stream));
+	wchar_t sb[MAX_SYMBOL_LENGTH + 1];
+	const unsigned char *start = rd->p;
+	size_t i, n;
+	int    d;
+
+	/* a number ends at the first byte that is not a digit */
+	for (;;) {
+		if (t->kind == L_Num) {
+			while (rd->p < rd->end && '0' <= *rd->p && *rd->p <= '9') {
+				d = *rd->p++ - '0';
+				if (t->num > (NUMBER_MAX - d) / 10) {
+					t->big = true;
+				}
+				t->num = 10 * t->num + d;
+			}
+		} else {
+			rd->p = span_alnum(rd->p, rd->end);
+		}
+		if (rd->p < rd->end || rd->eof) {
+			break;
+		}
+		start = refill(rd, start);
+	}
+
+	if (t->kind == L_Symbol) {
+		n = rd->p - start;
+		n = n < MAX_SYMBOL_LENGTH ? n : MAX_SYMBOL_LENGTH;
+		for (i = 0; i < n; i++) {
+			sb[i] = start[i];
+		}
+		sb[n] = L'\0';
+		t->sym = intern(sb);
+	}
 }
 
 
-static const Exp *read_lambda_exp(FILE *stream)
+/* lex - reads the next token */
+
+static void lex(Reader *rd, Token *t)
 {
-	const Exp *param = 0, *body = 0, *exp = 0;
+	unsigned char c;
 
-	param = read_symbol_exp(stream);
-	read_dot(stream);
-	body = read_exp_sequence(stream);
-	exp = make_lambda_exp(param, body);
+	skip_space(rd);
 
-	return exp;
+	t->sym = 0;
+	t->num = 0;
+	t->big = false;
+	if (rd->p == rd->end) {
+		t->kind = L_EOF;
+		t->ch   = WEOF;
+		return;
+	}
+
+	c = *rd->p;
+	t->ch = c;
+	if ('0' <= c && c <= '9') {
+		t->kind = L_Num;
+		lex_word(rd, t);
+		return;
+	} else if (is_alnum(c)) {
+		t->kind = L_Symbol;
+		lex_word(rd, t);
+		return;
+	}
+
+	++rd->p;
+	switch (c) {
+	case '\\':	t->kind = L_Lambda;	break;
+	case '\'':	t->kind = L_Quote;	break;
+	case '(':	t->kind = L_LParen;	break;
+	case ')':	t->kind = L_RParen;	break;
+	case '.':	t->kind = L_Dot;	break;
+	case '=':	t->kind = L_Assign;	break;
+	case ',':	t->kind = L_Comma;	break;
+	default:	t->kind = L_Other;	break;
+	}
 }
 
-static void read_dot(FILE * stream)
-{
-	wint_t ch = 0;
 
-	ch = read_char(stream, true);
+/* peek - returns the next token, leaving it to be read again */
 
-	if (ch != L'.') {
-		parse_error(L"expected '.', found '%lc'\n", ch);
+static Token peek(Reader *rd)
+{
+	if (!rd->peeked) {
+		lex(rd, &rd->tok);
+		rd->peeked = true;
 	}
+
+	return rd->tok;
 }
 
 
-/* read_symbol - read a symbol from a stream */
+/* next - reads the next token */
+
+static Token next(Reader *rd)
+{
+	Token t = peek(rd);
+
+	rd->peeked = false;
+
+	return t;
+}
+
 
-static const Exp *read_symbol_exp(FILE *stream)
+const Exp *read_statement(Reader *rd)
 {
-	#define MAX_SYMBOL_LENGTH (64)
-	const size_t max_symbol_length = 64;
-	wchar_t sb[MAX_SYMBOL_LENGTH + 1], *sp = 0;
-	wint_t ch = 0;
-
-	/* initialize */
-	sp = sb;
-	ch = read_char(stream, true);	/* skip whitespace */
-
-	/* loop while char is alpha-numeric */
-	while (L'a' <= ch && ch <= L'z'
-		|| L'A' <= ch && ch <= L'Z'
-		|| L'0' <= ch && ch <= L'9') {
-		if (sp < sb + max_symbol_length) {
-			*sp++ = ch;
+	const Exp *stmt = 0, *lhs, *rhs;
+	clock_t    start = read_stats ? clock() : 0;
+	Token      t;
+
+	if ((lhs = read_exp_list(rd)) != 0) {
+
+		/* Peek at next token. */
+		t = peek(rd);
+
+		if (t.kind == L_Assign) { /* Assignment. */
+			next(rd);
+			if ((rhs = read_exp_sequence(rd)) == 0) {
+				expected(L"an expression after '='", rd);
+			}
+			stmt = make_assign_exp(lhs, rhs);
+		} else if (t.kind == L_Comma) { /* Sequence. */
+			next(rd);
+			if ((rhs = read_exp_sequence(rd)) == 0) {
+				expected(L"an expression after ','", rd);
+			}
+			stmt = make_seq_exp(lhs, rhs);
+		} else { /* Simple list. */
+			stmt = lhs;
 		}
-		ch = read_char(stream, false);
+
+		read_dot(rd);
+		if (stmt != lhs && stmt->type == T_Exp_Assign
+		    && lhs->type != T_Exp_Symbol) {
+			parse_error(rd, L"expected a symbol before '='\n");
+		}
+	} else if ((t = next(rd)).kind != L_EOF) {
+		parse_error(rd, L"unexpected '%lc'\n", t.ch);
 	}
 
-	/* put back non-alpha-numeric char */
-	unread_char(ch, stream); 
+	if (read_stats) {
+		rd->elapsed += clock() - start;
+	}
 
-	/* assert one or more characters were read */
-	assert(sp != sb);
+	return stmt;
+}
 
-	/* null terminate string */
-	*sp = L'\0';
 
-	/* make and return symbol expression */
-	return make_symbol_exp(sb);
-}
+static const Exp *read_exp_sequence(Reader *rd)
+{
+	const Exp *lst = 0, *seq = 0;
 
+	if ((seq = read_exp_list(rd)) == 0) {
+		return 0;
+	}
 
-  /* read_num - read a number from a stream */
+	while (peek(rd).kind == L_Comma) {
+		next(rd);
+		if ((lst = read_exp_list(rd)) == 0) {
+			expected(L"an expression after ','", rd);
+		}
+		seq = make_seq_exp(seq, lst);
+	}
 
-static const Exp *read_num_exp(FILE *stream)
+	return seq;
+}
+
+
+static const Exp *read_exp_list_delim(wint_t c, Reader *rd)
 {
-	wint_t       ch   = 0;
-	unsigned int nval = 0;
+    const Exp *e = 0;
+
+    e = read_exp_list(rd);
+    if (e != 0 && next(rd).ch != c) {
+		parse_error(rd, L"expected '%c'\n", c);
+    }
 
-	/* initialize */
-	ch = read_char(stream, true);	/* skip whitespace */
+    return e;
+}
 
-	/* loop while char is numeric */
-	while (L'0' <= ch && ch <= L'9') {
-		nval *= 10;
-		nval += (ch - L'0');
-		ch = read_char(stream, false);
+
+static const Exp *read_exp_list(Reader *rd)
+{
+	const Exp *exp = 0, *lst = 0;
+
+	if ((exp = read_exp(rd)) == 0) {
+		return 0;
 	}
 
-	/* put back non-alpha-numeric char */
-	unread_char(ch, stream);
+	for (lst = read_exp(rd); lst != 0; lst = read_exp(rd)) {
+		exp = make_pair_exp(exp, lst);
+	}
 
-	/* make and return number expression */
-	return make_num_exp(nval);
+	return exp;
 }
 
 
-/* read_char - read a character, optionally skipping whitespace */
+const Exp *read_exp(Reader *rd)
+{
+	Token t = peek(rd);
+
+	switch (t.kind) {
+	case L_Lambda:
+		next(rd);
+		return read_lambda_exp(rd);
+	case L_Quote:
+		next(rd);
+		return read_quote_exp(rd);
+	case L_LParen:
+		next(rd);
+		return read_sub_exp(rd);
+	case L_Symbol:
+		next(rd);
+		return make_symbol_exp(t.sym);
+	case L_Num:
+		next(rd);
+		if (t.big) {
+			parse_error(rd, L"number too large: more than %llu\n",
+				NUMBER_MAX);
+		}
+		return make_num_exp(t.num);
+	default:
+		/* invalid expression */
+		return 0;
+	}
+}
+
 
-static wint_t read_char(FILE *stream, bool skip_space)
+static const Exp *read_sub_exp(Reader *rd)
 {
-	wint_t ch = 0;
+	return read_exp_list_delim(rparen, rd);
+}
 
-	/* initialize */
-	ch = get_char(stream);
 
-	if (skip_space) {
-		while (ch == space || ch == tab || ch == newline || ch == creturn) {
-			ch = get_char(stream);
-		}
+static const Exp *read_quote_exp(Reader *rd)
+{
+	const Exp *exp = read_exp(rd);
+
+	if (exp == 0) {
+		expected(L"an expression after '''", rd);
 	}
 
-	return ch;
+	return make_quote_exp(exp);
 }
 
 
-static wint_t get_char(FILE *stream)
+static const Exp *read_lambda_exp(Reader *rd)
 {
-	wint_t c;
-    
-	/* comments*/
-	if ((c = fgetwc(stream)) == comment) {
-		while (c != newline) {
-			c = fgetwc(stream);
-		}
+	const Exp *param = 0, *body = 0, *exp = 0;
+	Token t = next(rd);
+
+	if (t.kind != L_Symbol) {
+		parse_error(rd, L"expected a parameter, found '%lc'\n", t.ch);
+	}
+	param = make_symbol_exp(t.sym);
+	read_dot(rd);
+	if ((body = read_exp_sequence(rd)) == 0) {
+		expected(L"the body of a lambda", rd);
+	}
+	exp = make_lambda_exp(param, body);
+
+	return exp;
+}
+
+static void read_dot(Reader *rd)
+{
+	Token t = next(rd);
+
+	if (t.kind != L_Dot) {
+		parse_error(rd, L"expected '.', found '%lc'\n", t.ch);
 	}
+}
+
 
-	return c;
+/* expected - reports what was expected where the next token is, in
+   place of an expression the grammar requires */
+
+static const Exp *expected(const wchar_t *what, Reader *rd)
+{
+	return parse_error(rd, L"expected %ls, found '%lc'\n", what, peek(rd).ch);
 }
 
 
-static void unread_char(wint_t ch, FILE *stream)
+/* read_report - reports the parse rate */
+
+void read_report(FILE *stream)
 {
-	if (ch != WEOF) {
-		ungetwc(ch, stream);
-	}
+	double secs = (double)reading / CLOCKS_PER_SEC;
+
+	fwprintf(stream, L";; %lu bytes read in %.3f ms, %.1f MB/s\n",
+		nread, secs * 1000.0,
+		secs > 0 ? nread / secs / (1024 * 1024) : 0.0);
 }
 
 
-static const Exp *parse_error(const wchar_t *fmt, ...)
+/* parse_error - reports a syntax error, skips the rest of the
+   statement, and fails */
+
+static const Exp *parse_error(Reader *rd, const wchar_t *fmt, ...)
 {
 	va_list ap;
+	Token t = rd->tok;
 
 	/* format msg */
 	va_start(ap, fmt);
 	vfwprintf(stderr, fmt, ap);
 	va_end(ap);
 
-	exit(1);
+	/* the last token read, unless peeked, may end the statement */
+	if (rd->peeked || t.kind != L_Dot) {
+		do {
+			t = next(rd);
+		} while (t.kind != L_Dot && t.kind != L_EOF);
+	}
+
+	fail();
 
 	return 0;
 }
-
@@ -11,8 +11,13 @@
 
  /* Function prototypes. */
 
-const Exp *read_exp(FILE *);
-const Exp *read_statement(FILE *);
+Reader    *reader_open(FILE *stream);
+void       reader_close(Reader *rd);
+const Exp *read_exp(Reader *rd);
+const Exp *read_statement(Reader *rd);
+void       read_report(FILE *stream);
+
+extern bool read_stats;
 
 /* AUTHOR
 /*	Brent Harp
@@ -0,0 +1,119 @@
+/*++
+/* NAME
+/*	resolve 3
+/* SUMMARY
+/*	Lexical addressing.
+/* SYNOPSIS
+/*	#include <resolve.h>
+/*
+/*	const Exp *resolve(exp);
+/*	const Exp *exp;
+/* DESCRIPTION
+/*	resolve() rewrites the variable references of a statement into
+/*	lexical addresses, so the evaluator can find their values
+/*	without comparing names.
+/*
+/*	A reference to a variable bound by an enclosing lambda becomes
+/*	a T_Exp_Local expression whose nval is the number of frames to
+/*	skip: 0 for the innermost lambda, 1 for the one around it, and
+/*	so on. Every frame made by apply() binds exactly one name, so
+/*	the value is always the first binding of that frame.
+/*
+/*	Any other reference becomes a T_Exp_Global expression whose nval
+/*	is the global slot of the name (see global_slot() in env(3)).
+/*	The slot holds whatever value is bound to the name at the time
+/*	the reference is evaluated, so a name may be used before it is
+/*	defined, and redefinitions are seen by existing functions.
+/*
+/*	Quoted expressions, lambda parameters and the left hand side of
+/*	assignments are not variable references and are left alone.
+/*	Resolved expressions keep their names, so they print exactly as
+/*	they were read.
+/*--*/
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "types.h"
+#include "exp.h"
+#include "env.h"
+#include "resolve.h"
+
+
+ /* structure definitions */
+
+typedef struct Scope Scope;
+
+struct Scope {
+	Symbol       name;
+	const Scope *link;
+};
+
+
+/* resolve_symbol - resolves a variable reference */
+
+static const Exp *resolve_symbol(const Exp *exp, const Scope *scope)
+{
+	int depth = 0;
+
+	for (; scope != 0; scope = scope->link, depth++) {
+		if (scope->name == exp->sval) {
+			return make_local_exp(exp->sval, depth);
+		}
+	}
+
+	return make_global_exp(exp->sval, global_slot(exp->sval));
+}
+
+
+/* resolve_exp - resolves an expression in a scope */
+
+static const Exp *resolve_exp(const Exp *exp, const Scope *scope)
+{
+	Scope inner;
+
+	assert(exp != 0);
+
+	switch (exp->type) {
+	case T_Exp_Symbol:
+		return resolve_symbol(exp, scope);
+
+	case T_Exp_Lambda:
+		inner.name = exp->child[0]->sval;
+		inner.link = scope;
+		return make_lambda_exp(exp->child[0],
+			resolve_exp(exp->child[1], &inner));
+
+	case T_Exp_Pair:
+		return make_pair_exp(resolve_exp(exp->child[0], scope),
+			resolve_exp(exp->child[1], scope));
+
+	case T_Exp_Assign:
+		return make_assign_exp(exp->child[0],
+			resolve_exp(exp->child[1], scope));
+
+	case T_Exp_Seq:
+		return make_seq_exp(resolve_exp(exp->child[0], scope),
+			resolve_exp(exp->child[1], scope));
+
+	case T_Exp_Quote:
+	case T_Exp_Num:
+	case T_Exp_Local:
+	case T_Exp_Global:
+		return exp;
+
+	default:
+		fwprintf(stderr, L"%s: %d: %s: illegal expression type\n",
+			__FILE__, __LINE__, "resolve");
+		exit(EXIT_FAILURE);
+	}
+}
+
+
+/* resolve - resolves the variable references of an expression */
+
+const Exp *resolve(const Exp *exp)
+{
+	return resolve_exp(exp, 0);
+}
@@ -0,0 +1,19 @@
+#ifndef _RESOLVE_H_INCLUDED_
+#define _RESOLVE_H_INCLUDED_
+#include "types.h"
+/*++
+/* NAME
+/*	resolve 3h
+/* SUMMARY
+/*	Lexical addressing.
+/* DESCRIPTION
+/* .nf
+
+ /* Function prototypes */
+
+const Exp *resolve(const Exp *exp);
+
+/* AUTHOR
+/*	Brent Harp
+/*--*/
+#endif
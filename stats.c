@@ -0,0 +1,128 @@
+/*++
+/* NAME
+/*	stats 3
+/* SUMMARY
+/*	Runtime counters.
+/* SYNOPSIS
+/*	#include <stats.h>
+/*
+/*	STAT(expr);
+/*
+/*	STAT_WALK(n);
+/*
+/*	void	stats_attach();
+/*
+/*	void	stats_report(stream);
+/*	FILE	*stream;
+/* DESCRIPTION
+/*	The evaluator counts what it does on its hot paths in the
+/*	fields of counts, a structure of its thread: the expressions
+/*	run() evaluates, by type; the thunks made by promise() and by
+/*	the bytecode machine of vm(3); the thunks evaluated when forced
+/*	for the first time, and those forced again, whose value is
+/*	taken from the thunk; the arguments passed without a thunk, and
+/*	the links of thunk chains removed by compress(); the functions
+/*	and builtins applied by either engine, whose sum is the number
+/*	of reductions; the frames link() makes; and the bytes of the
+/*	objects allocated by gc_alloc() (see gc(3)). STAT() evaluates a
+/*	counting expression, and STAT_WALK() counts a local lookup that
+/*	passed n bindings, in get_binding() by name or in lookup_local()
+/*	by lexical address (see env(3)).
+/*
+/*	Compiled with -DNSTATS, as with make CFLAGS="-g -DNSTATS", the
+/*	counting expressions are compiled out, and stats_report() says
+/*	so.
+/*
+/*	Each thread registers its counters with stats_attach().
+/*	stats_report() writes the totals of all threads to stream. The
+/*	REPL writes them at exit with the --stats option, and the stats
+/*	builtin of eval(3) writes them when it is called.
+/* BUGS
+/*	The counters of the other threads are read without locking, so
+/*	a report made while they run is approximate.
+/*--*/
+
+#include <stdio.h>
+
+#include "types.h"
+#include "par.h"
+#include "stats.h"
+
+
+ /* static data */
+
+THREAD_LOCAL Counts counts;
+
+static Counts *threads[PAR_MAX_THREADS];	/* see stats_attach() */
+
+#ifndef NSTATS
+static const wchar_t *exp_names[] = {
+	L"symbol", L"lambda", L"pair", L"quote", L"assign", L"seq",
+	L"num", L"local", L"global"
+};
+#endif
+
+
+/* stats_attach - registers the counters of the calling thread */
+
+void stats_attach(void)
+{
+	threads[par_self()] = &counts;
+}
+
+
+/* stats_report - reports the counters of all threads */
+
+void stats_report(FILE *stream)
+{
+#ifdef NSTATS
+	fwprintf(stream, L";; statistics not compiled in\n");
+#else
+	Counts sum = { { 0 } };
+	const Counts *s = 0;
+	int i, t;
+
+	for (i = 0; i <= par_threads; i++) {
+		if ((s = threads[i]) == 0) {
+			continue;
+		}
+		for (t = 0; t <= T_Exp_Global; t++) {
+			sum.evals[t] += s->evals[t];
+		}
+		sum.promised   += s->promised;
+		sum.forced     += s->forced;
+		sum.cached     += s->cached;
+		sum.avoided    += s->avoided;
+		sum.compressed += s->compressed;
+		sum.applied    += s->applied;
+		sum.called     += s->called;
+		sum.linked     += s->linked;
+		sum.lookups    += s->lookups;
+		sum.walked     += s->walked;
+		sum.bytes      += s->bytes;
+		if (s->longest > sum.longest) {
+			sum.longest = s->longest;
+		}
+	}
+
+	fputws(L";; evaluated:", stream);
+	for (t = 0; t <= T_Exp_Global; t++) {
+		fwprintf(stream, L" %lu ", sum.evals[t]);
+		fputws(exp_names[t], stream);
+	}
+	fputwc(L'\n', stream);
+	fwprintf(stream, L";; %lu thunks promised, %lu forced,"
+		L" %lu forced again\n", sum.promised, sum.forced, sum.cached);
+	fwprintf(stream, L";; %lu arguments passed without a thunk,"
+		L" %lu thunk chain links removed\n", sum.avoided,
+		sum.compressed);
+	fwprintf(stream, L";; %lu functions applied, %lu builtins called,"
+		L" %lu frames linked\n", sum.applied, sum.called, sum.linked);
+	fwprintf(stream, L";; %lu local lookups passed %.2f bindings on"
+		L" average, %lu at most\n", sum.lookups,
+		sum.lookups > 0 ? (double)sum.walked / sum.lookups : 0.0,
+		sum.longest);
+	fwprintf(stream, L";; %lu bytes allocated by gc_alloc\n",
+		sum.bytes);
+#endif
+}
@@ -0,0 +1,56 @@
+#ifndef _STATS_H_INCLUDED_
+#define _STATS_H_INCLUDED_
+#include <stdio.h>
+#include "types.h"
+#include "par.h"
+/*++
+/* NAME
+/*	stats 3h
+/* SUMMARY
+/*	Runtime counters.
+/* DESCRIPTION
+/* .nf
+
+ /* counters of a thread */
+
+typedef struct Counts {
+	unsigned long evals[T_Exp_Global + 1];	/* by expression type */
+	unsigned long promised;	/* thunks made by promise() */
+	unsigned long forced;	/* thunks evaluated when forced */
+	unsigned long cached;	/* thunks forced again */
+	unsigned long avoided;	/* arguments passed without a thunk */
+	unsigned long compressed;	/* thunk chain links removed */
+	unsigned long applied;	/* functions applied */
+	unsigned long called;	/* builtins called */
+	unsigned long linked;	/* frames made by link() */
+	unsigned long lookups;	/* local lookups by name or address */
+	unsigned long walked;	/* bindings passed by them */
+	unsigned long longest;	/* the most passed by one */
+	unsigned long bytes;	/* allocated by gc_alloc() */
+} Counts;
+
+ /* counting, unless compiled with -DNSTATS */
+
+#ifdef NSTATS
+#define STAT(expr)	((void)sizeof(expr))	/* not evaluated */
+#else
+#define STAT(expr)	((void)(expr))
+#endif
+
+#define STAT_WALK(n)	STAT((++counts.lookups, counts.walked += (n), \
+			      (n) > counts.longest && (counts.longest = (n))))
+
+#define STAT_APPLY(fn)	STAT((fn)->param != 0 ? ++counts.applied \
+					      : ++counts.called)
+
+extern THREAD_LOCAL Counts counts;
+
+ /* Function prototypes */
+
+void	 stats_attach(void);
+void	 stats_report(FILE *stream);
+
+/* AUTHOR
+/*	Brent Harp
+/*--*/
+#endif
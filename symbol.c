@@ -0,0 +1,232 @@
+/*++
+/* NAME
+/*	symbol 3
+/* SUMMARY
+/*	Symbol table.
+/* SYNOPSIS
+/*	#include <symbol.h>
+/*
+/*	Symbol	intern(name);
+/*	const wchar_t *name;
+/*
+/*	Symbol	bind_symbol(name);
+/*	Symbol	name;
+/*
+/*	void	unbind_symbol(sym);
+/*	Symbol	sym;
+/*
+/*	void	symbol_report(stream);
+/*	FILE	*stream;
+/* DESCRIPTION
+/*	intern() returns the unique symbol with the given name. The
+/*	first call for a name copies the name into the symbol table;
+/*	later calls with an equal name return the same copy. Symbols
+/*	can therefore be compared with == instead of wcscmp(), and
+/*	printed as ordinary wide strings.
+/*
+/*	The symbol table is an open-addressing hash table that doubles
+/*	in size when it is half full. Symbols are never freed.
+/*
+/*	bind_symbol() and unbind_symbol() choose the names of the lambdas
+/*	of a normal form (see norm(3) and inet(3)). bind_symbol() returns
+/*	name, or name with the smallest number appended that is not bound
+/*	already, and binds it; unbind_symbol() releases it again. Each
+/*	symbol counts its bindings, and a name remembers the last number
+/*	appended to it, so a new name is found in constant time however
+/*	deep the lambdas are nested.
+/*
+/*	symbol_report() writes the number of symbols to stream.
+/*
+/*	The table is locked while it is used, as the worker threads of
+/*	par(3) intern symbols too.
+/* DIAGNOSTICS
+/*	Memory allocation errors are fatal errors.
+/*--*/
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+#include "types.h"
+#include "par.h"
+#include "symbol.h"
+#include "heap.h"
+
+
+ /* structure definitions */
+
+typedef struct Entry Entry;
+
+struct Entry {
+	Symbol name;
+	Symbol base;		/* name it was made from by bind_symbol() */
+	int    suffix;		/* number appended to base */
+	int    bound;		/* number of bindings */
+	int    last;		/* last number appended by bind_symbol() */
+};
+
+
+ /* static data */
+
+static Entry  *table = 0;		/* hash table of symbols */
+static size_t  size  = 0;		/* number of slots, a power of 2 */
+static size_t  count = 0;		/* number of symbols */
+static Mutex   lock  = MUTEX_INITIALIZER;
+
+
+/* hash - hashes a name (FNV-1a) */
+
+static size_t hash(const wchar_t *name)
+{
+	size_t h = 2166136261u;
+
+	for (; *name != L'\0'; name++) {
+		h ^= (size_t)*name;
+		h *= 16777619u;
+	}
+
+	return h;
+}
+
+
+/* find - returns the slot of name in the table */
+
+static Entry *find(Entry *tbl, size_t sz, const wchar_t *name)
+{
+	size_t i;
+
+	for (i = hash(name) & (sz - 1); tbl[i].name != 0;
+	     i = (i + 1) & (sz - 1)) {
+		if (wcscmp(tbl[i].name, name) == 0) {
+			break;
+		}
+	}
+
+	return &tbl[i];
+}
+
+
+/* grow - doubles the size of the table */
+
+static void grow(void)
+{
+	Entry  *old = table;
+	size_t  osz = size, i;
+
+	size  = size != 0 ? size * 2 : 256;
+	table = (Entry *)calloc(size, sizeof(*table));
+	assert(table != 0);
+
+	for (i = 0; i < osz; i++) {
+		if (old[i].name != 0) {
+			*find(table, size, old[i].name) = old[i];
+		}
+	}
+
+	free(old);
+}
+
+
+/* insert - returns the unique symbol for name, with the table locked */
+
+static Symbol insert(const wchar_t *name)
+{
+	Entry   *slot = 0;
+	wchar_t *sym  = 0;
+
+	assert(name != 0);
+
+	if (2 * (count + 1) > size) {
+		grow();
+	}
+
+	slot = find(table, size, name);
+	if (slot->name == 0) {
+		sym = (wchar_t *)malloc((wcslen(name) + 1) * sizeof(*sym));
+		assert(sym != 0);
+		wcscpy(sym, name);
+		slot->name = sym;
+		++count;
+		if (heap_profiling) {
+			heap_note_symbol((wcslen(name) + 1) * sizeof(*sym));
+		}
+	}
+
+	return slot->name;
+}
+
+
+/* intern - returns the unique symbol for name */
+
+Symbol intern(const wchar_t *name)
+{
+	Symbol sym = 0;
+
+	par_lock(&lock);
+	sym = insert(name);
+	par_unlock(&lock);
+
+	return sym;
+}
+
+
+/* bind_symbol - binds name, or a new name made from it if it is bound */
+
+Symbol bind_symbol(Symbol name)
+{
+	wchar_t buf[64];
+	Entry  *ent = 0;
+	Symbol  sym = name;
+	int     i;
+
+	par_lock(&lock);
+	ent = find(table, size, name);
+	if (ent->bound > 0) {
+		for (i = ent->last + 1; ; i++) {
+			swprintf(buf, 64, L"%.50ls%d", name, i);
+			sym = insert(buf);
+			ent = find(table, size, sym);
+			if (ent->bound == 0) {
+				break;
+			}
+		}
+		ent->base   = name;
+		ent->suffix = i;
+		find(table, size, name)->last = i;
+		ent = find(table, size, sym);
+	}
+
+	++ent->bound;
+	par_unlock(&lock);
+
+	return sym;
+}
+
+
+/* unbind_symbol - releases a binding made by bind_symbol() */
+
+void unbind_symbol(Symbol sym)
+{
+	Entry *ent = 0, *base = 0;
+
+	par_lock(&lock);
+	ent = find(table, size, sym);
+	assert(ent->bound > 0);
+
+	if (--ent->bound == 0 && ent->base != 0) {
+		base = find(table, size, ent->base);
+		if (base->last == ent->suffix) {
+			base->last = ent->suffix - 1;
+		}
+	}
+	par_unlock(&lock);
+}
+
+
+/* symbol_report - reports the size of the symbol table */
+
+void symbol_report(FILE *stream)
+{
+	fwprintf(stream, L";; %lu symbols\n", (unsigned long)count);
+}
@@ -0,0 +1,23 @@
+#ifndef _SYMBOL_H_INCLUDED_
+#define _SYMBOL_H_INCLUDED_
+#include <stdio.h>
+#include "types.h"
+/*++
+/* NAME
+/*	symbol 3h
+/* SUMMARY
+/*	Symbol table.
+/* DESCRIPTION
+/* .nf
+
+ /* Function prototypes */
+
+Symbol	 intern(const wchar_t *name);
+Symbol	 bind_symbol(Symbol name);
+void	 unbind_symbol(Symbol sym);
+void	 symbol_report(FILE *stream);
+
+/* AUTHOR
+/*	Brent Harp
+/*--*/
+#endif
@@ -0,0 +1,269 @@
+/*++
+/* NAME
+/*	trace 3
+/* SUMMARY
+/*	Timeline of evaluation spans.
+/* SYNOPSIS
+/*	#include <trace.h>
+/*
+/*	void	trace_start(path);
+/*	const char *path;
+/*
+/*	double	trace_now();
+/*
+/*	void	trace_span(kind, name, n, start);
+/*	enum Trace_Kind kind;
+/*	Symbol	name;
+/*	int	n;
+/*	double	start;
+/*
+/*	void	trace_force(depth);
+/*	int	depth;
+/*
+/*	void	trace_forced(depth);
+/*	int	depth;
+/*
+/*	bool	tracing;
+/*
+/*	double	trace_min;
+/* DESCRIPTION
+/*	The tracer records spans of evaluation, and writes them as a
+/*	timeline in the trace event format of Chrome, which Perfetto
+/*	and chrome://tracing read.
+/*
+/*	trace_start() opens the file at path, sets tracing, and keeps
+/*	the shadow stack of profile(3), which reports the application of
+/*	each named function when it ends. The trace is written to the
+/*	file when the program exits.
+/*
+/*	trace_now() returns the time in microseconds since the trace
+/*	started. trace_span() records a span of kind that started at
+/*	start and ends now: a top-level statement, numbered n and
+/*	labelled by the name an assignment defines, if any; a call of
+/*	load, of the file name; or the application of the function
+/*	name. trace_force() marks the start of the evaluation of a
+/*	thunk whose update is at depth of the continuation stack of
+/*	eval(3), and trace_forced() records it when the thunk has been
+/*	updated. Applications and evaluations of thunks shorter than
+/*	trace_min microseconds, TRACE_MIN unless the --trace-min option
+/*	says otherwise, are not recorded, so that the trace shows where
+/*	the time goes and not every step.
+/*
+/*	Spans are kept in a ring buffer of TRACE_EVENTS, allocated up
+/*	front, so recording one takes a few stores; once it is full the
+/*	oldest spans are overwritten, and the trace holds the last
+/*	TRACE_EVENTS of the run.
+/* DIAGNOSTICS
+/*	Failing to open the trace is a fatal error. The number of spans
+/*	recorded, and of spans overwritten, is reported on stderr at
+/*	exit.
+/* BUGS
+/*	Only the main thread is traced.
+/*--*/
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif
+
+#include "types.h"
+#include "profile.h"
+#include "trace.h"
+
+
+ /* structure definitions */
+
+typedef struct Event {
+	enum Trace_Kind kind;
+	Symbol          name;
+	int             n;	/* statement number */
+	double          start;	/* microseconds */
+	double          dur;
+} Event;
+
+typedef struct Force {
+	int    depth;		/* of the update */
+	double start;
+} Force;
+
+
+ /* static data */
+
+bool   tracing   = false;
+double trace_min = TRACE_MIN;
+
+static FILE          *out      = 0;
+static const char    *out_path = 0;
+static double         origin   = 0;	/* seconds */
+static Event         *events   = 0;	/* the ring buffer */
+static unsigned long  nevents  = 0;	/* recorded */
+static Force         *forces   = 0;
+static int            nforces  = 0;
+
+static const wchar_t *categories[] = {
+	L"statement", L"load", L"function", L"force"
+};
+
+
+/* seconds - returns the time in seconds since some fixed point */
+
+static double seconds(void)
+{
+#if defined(_WIN32)
+	LARGE_INTEGER now, freq;
+
+	QueryPerformanceCounter(&now);
+	QueryPerformanceFrequency(&freq);
+	return (double)now.QuadPart / freq.QuadPart;
+#else
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+#endif
+}
+
+
+/* write_name - writes a string as the contents of a JSON string */
+
+static void write_name(const wchar_t *s, FILE *stream)
+{
+	for (; *s != 0; s++) {
+		if (*s == L'"' || *s == L'\\') {
+			fputwc(L'\\', stream);
+			fputwc(*s, stream);
+		} else if (*s < 0x20) {
+			fwprintf(stream, L"\\u%04x", (unsigned)*s);
+		} else {
+			fputwc(*s, stream);
+		}
+	}
+}
+
+
+/* write_trace - writes the spans in the ring buffer; called at exit */
+
+static void write_trace(void)
+{
+	const Event *e = 0;
+	unsigned long i, first;
+
+	tracing = false;
+	first = nevents > TRACE_EVENTS ? nevents - TRACE_EVENTS : 0;
+
+	fputws(L"{\"traceEvents\":[\n", out);
+	for (i = first; i < nevents; i++) {
+		e = &events[i & (TRACE_EVENTS - 1)];
+		fputws(L"{\"name\":\"", out);
+		switch (e->kind) {
+		case TR_Statement:
+			fwprintf(out, L"statement %d", e->n);
+			if (e->name != 0) {
+				fputws(L": ", out);
+				write_name(e->name, out);
+			}
+			break;
+		case TR_Load:
+			fputws(L"load ", out);
+			write_name(e->name, out);
+			break;
+		case TR_Function:
+			write_name(e->name, out);
+			break;
+		case TR_Force:
+			fputws(L"thunk", out);
+			break;
+		}
+		fwprintf(out, L"\",\"cat\":\"%ls\",\"ph\":\"X\",\"ts\":%.3f,"
+			L"\"dur\":%.3f,\"pid\":1,\"tid\":1}%ls\n",
+			categories[e->kind], e->start, e->dur,
+			i + 1 < nevents ? L"," : L"");
+	}
+	fputws(L"],\"displayTimeUnit\":\"ms\"}\n", out);
+	fclose(out);
+
+	fwprintf(stderr, L";; %lu spans, %lu overwritten, written to %s\n",
+		nevents, first, out_path);
+}
+
+
+/* trace_start - starts recording into the trace at path */
+
+void trace_start(const char *path)
+{
+	if ((out = fopen(path, "w")) == 0) {
+		fwprintf(stderr, L"%s: cannot open %s\n", "trace", path);
+		exit(EXIT_FAILURE);
+	}
+	out_path = path;
+
+	events = calloc(TRACE_EVENTS, sizeof(*events));
+	forces = calloc(TRACE_FORCES, sizeof(*forces));
+	assert(events != 0 && forces != 0);
+
+	origin  = seconds();
+	tracing = true;
+	profile_keep();
+	atexit(write_trace);
+}
+
+
+/* trace_now - returns the microseconds since the trace started */
+
+double trace_now(void)
+{
+	return (seconds() - origin) * 1e6;
+}
+
+
+/* trace_span - records a span that ends now */
+
+void trace_span(enum Trace_Kind kind, Symbol name, int n, double start)
+{
+	double dur = trace_now() - start;
+	Event *e = 0;
+
+	if ((kind == TR_Function || kind == TR_Force) && dur < trace_min) {
+		return;
+	}
+
+	e = &events[nevents++ & (TRACE_EVENTS - 1)];
+	e->kind  = kind;
+	e->name  = name;
+	e->n     = n;
+	e->start = start;
+	e->dur   = dur;
+}
+
+
+/* trace_force - marks the start of the evaluation of a thunk */
+
+void trace_force(int depth)
+{
+	while (nforces > 0 && forces[nforces - 1].depth >= depth) {
+		--nforces;		/* unwound without an update */
+	}
+	if (nforces < TRACE_FORCES) {
+		forces[nforces].depth = depth;
+		forces[nforces].start = trace_now();
+		++nforces;
+	}
+}
+
+
+/* trace_forced - records the evaluation of a thunk, now updated */
+
+void trace_forced(int depth)
+{
+	while (nforces > 0 && forces[nforces - 1].depth > depth) {
+		--nforces;
+	}
+	if (nforces > 0 && forces[nforces - 1].depth == depth) {
+		--nforces;
+		trace_span(TR_Force, 0, 0, forces[nforces].start);
+	}
+}
@@ -0,0 +1,43 @@
+#ifndef _TRACE_H_INCLUDED_
+#define _TRACE_H_INCLUDED_
+#include "types.h"
+/*++
+/* NAME
+/*	trace 3h
+/* SUMMARY
+/*	Timeline of evaluation spans.
+/* DESCRIPTION
+/* .nf
+
+ /* constants */
+
+#define TRACE_EVENTS	(64 * 1024)	/* spans kept, a power of 2 */
+#define TRACE_MIN	(100.0)		/* default threshold, microseconds */
+#define TRACE_FORCES	(64 * 1024)	/* thunks under evaluation */
+
+
+ /* kinds of spans */
+
+enum Trace_Kind {
+	TR_Statement,		/* a top-level statement of the REPL */
+	TR_Load,		/* a call of load */
+	TR_Function,		/* an application of a named function */
+	TR_Force		/* the evaluation of a thunk */
+};
+
+
+ /* Function prototypes */
+
+void	 trace_start(const char *path);
+double	 trace_now(void);
+void	 trace_span(enum Trace_Kind kind, Symbol name, int n, double start);
+void	 trace_force(int depth);
+void	 trace_forced(int depth);
+
+extern bool   tracing;
+extern double trace_min;
+
+/* AUTHOR
+/*	Brent Harp
+/*--*/
+#endif
@@ -36,7 +36,9 @@ enum Exp_Type {
 	T_Exp_Quote,
 	T_Exp_Assign,
 	T_Exp_Seq,
-	T_Exp_Num
+	T_Exp_Num,
+	T_Exp_Local,		/* resolved reference to a lambda parameter */
+	T_Exp_Global		/* resolved reference to a global name */
 };
 
 
@@ -46,7 +48,8 @@ enum Type {
 	T_Exp,
 	T_Function,
 	T_Thunk,
-	T_Env
+	T_Env,
+	T_Num			/* native number */
 };
 
 
@@ -56,11 +59,19 @@ typedef enum   Type     Type;
 typedef enum   Exp_Type Exp_Type;
 typedef union  Object   Object;
 typedef struct Env      Env;		/* environments */
+typedef struct Globals  Globals;	/* global contexts, see env(3) */
 typedef struct Binding  Binding;
 typedef struct Function Function;
 typedef struct Exp      Exp;		/* expressions */
 typedef struct Value    Value;
 typedef struct Thunk    Thunk;
+typedef struct Code     Code;		/* compiled code, see vm(3) */
+typedef struct Reader   Reader;		/* source readers, see read(3) */
+typedef struct Module   Module;		/* loaded files, see module(3) */
+typedef const wchar_t  *Symbol;	/* interned names, see symbol(3) */
+typedef unsigned long long Number;	/* native numbers, see num(3) */
+
+#define NUMBER_MAX ((Number)-1)
 
 
  /* Procedure - funcation call procedure */
@@ -75,6 +86,7 @@ union Object {
 	Thunk     *thunk;
 	Env       *env;
 	void      *und;
+	Number     num;
 };
 
 
@@ -85,25 +97,39 @@ struct Value {
 	Object data;
 };
 
+/* The Function or Thunk of a value of type T_Function or T_Thunk is
+   allocated with the value, in the same object, right after it.
+   VALUE_OF() returns the value of such a Function or Thunk. */
+
+#define VALUE_OF(obj)	((const Value *)(obj) - 1)
+
 
  /* Exp - an expression */
 
+/* Expressions are allocated with only the fields of their type (see
+   exp(3)): sval for symbols, num for numbers, sval and nval for
+   lexical references, and exp_arity() children for the others. */
+
 struct Exp {
 	Exp_Type type;
-	const wchar_t *sval;
-	const Exp *child[2];
 	int nval;
+	union {
+		Symbol sval;
+		Number num;
+		const Exp *child[2];
+	};
 };
 
 
  /* Function - a function object */
 
 struct Function {
-	const wchar_t *name;
+	Symbol name;
 	const Exp *param;
 	const Exp *body;
 	Env *env;
 	Procedure apply;
+	const Code *code;	/* compiled body, or 0 */
 };
 
 
@@ -113,6 +139,7 @@ struct Thunk {
 	const Value *value;
 	const Exp *exp;
 	Env *env;
+	const Code *code;	/* compiled exp, or 0 */
 };
 
 
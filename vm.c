@@ -0,0 +1,690 @@
+/*++
+/* NAME
+/*	vm 3
+/* SUMMARY
+/*	Bytecode compiler and virtual machine.
+/* SYNOPSIS
+/*	#include <vm.h>
+/*
+/*	const Code  *compile(exp);
+/*	const Exp   *exp;
+/*
+/*	const Value *vm_eval(exp, env);
+/*	const Exp   *exp;
+/*	Env         *env;
+/*
+/*	const Value *vm_run(code, env);
+/*	const Code  *code;
+/*	Env         *env;
+/*
+/*	const Value *vm_apply(fn, arg);
+/*	const Function *fn;
+/*	const Value *arg;
+/*
+/*	void	     scan_code(code);
+/*	const Code  *code;
+/*
+/*	void	     scan_vm();
+/*
+/*	void	     vm_unwind();
+/* DESCRIPTION
+/*	This module is an alternative to the tree walking evaluator of
+/*	eval(3), with the same lazy semantics. It is selected with the
+/*	--vm command line option.
+/*
+/*	compile() translates an expression into code for a stack
+/*	machine. The body of each lambda and each argument of an
+/*	application are compiled into code blocks of their own, which
+/*	become the code of a closure or of a thunk when the enclosing
+/*	code runs. Cheap arguments (see cheap() in eval(3)) are compiled
+/*	inline instead, and passed without a thunk. Numbers are pushed
+/*	as native numbers; applying one calls the compiled closure of
+/*	its Church encoding, which is compiled once and cached. An
+/*	application in tail position reuses the frame of its caller, so
+/*	tail calls run in constant stack. The number of frames is
+/*	limited by max_depth (see eval(3)).
+/*
+/*	vm_run() runs code in an environment and returns its value.
+/*	vm_eval() compiles an expression and runs it. vm_apply() is the
+/*	Procedure of compiled functions, used when they are called from
+/*	outside the virtual machine.
+/*
+/*	Closures and thunks made by the virtual machine are ordinary
+/*	Function and Thunk objects with their code attached, so they
+/*	are printed, forced and applied by the rest of the program as
+/*	usual. Forcing a compiled thunk, or calling a compiled function,
+/*	from inside the machine does not recurse in C; nor does applying
+/*	a builtin of num(3) to a compiled thunk, which is forced first.
+/*
+/*	When compiled with GCC or Clang the machine dispatches through
+/*	computed goto; otherwise it uses a switch.
+/*
+/*	scan_code() and scan_vm() mark the objects referred to by a code
+/*	block and by the stacks of the machine for the garbage collector.
+/*
+/*	vm_unwind() is called by fail() in eval(3). It empties the stacks
+/*	of the machine, and gives back the thunks under evaluation, so
+/*	they can be forced again.
+/* DIAGNOSTICS
+/*	Applying a value that is not a function, and exceeding max_depth,
+/*	are errors, reported as by eval(3).
+/*--*/
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "types.h"
+#include "gc.h"
+#include "env.h"
+#include "eval.h"
+#include "exp.h"
+#include "num.h"
+#include "stats.h"
+#include "heap.h"
+#include "vm.h"
+
+
+ /* opcodes */
+
+enum Opcode {
+	OP_LOCAL,		/* depth: push a lambda parameter */
+	OP_GLOBAL,		/* slot: push a global value */
+	OP_SYMBOL,		/* name: push a value looked up by name */
+	OP_QUOTE,		/* exp: push an expression */
+	OP_NUM,			/* n: push a native number */
+	OP_CLOSURE,		/* code: push a closure */
+	OP_THUNK,		/* code: push a thunk */
+	OP_FORCE,		/* force the value on top of the stack */
+	OP_APPLY,		/* apply function to argument */
+	OP_TAILAPPLY,		/* apply, reusing the current frame */
+	OP_POP,			/* discard the value on top of the stack */
+	OP_BIND,		/* name: bind the value on top of the stack */
+	OP_RETURN		/* return the value on top of the stack */
+};
+
+
+ /* kinds of frames */
+
+enum Frame_Kind {
+	F_Base,			/* return from vm_run() */
+	F_Call,			/* return to the caller */
+	F_Update,		/* store the result in a thunk */
+	F_Native		/* registers saved around a call into C */
+};
+
+
+ /* structure definitions */
+
+typedef union  Word   Word;
+typedef struct Frame  Frame;
+typedef struct Buffer Buffer;
+
+union Word {
+	int         op;
+	int         n;
+	Number      num;
+	const void *ptr;
+};
+
+struct Code {
+	const Exp *exp;		/* source: a lambda, or a thunk's expression */
+	int        size;	/* number of words */
+	Word       words[1];
+};
+
+struct Frame {
+	enum Frame_Kind kind;
+	const Code     *code;
+	const Word     *pc;
+	Env            *env;
+	Thunk          *thunk;	/* F_Update only */
+	const Code     *tcode;	/* the code and environment of the */
+	Env            *tenv;	/* thunk, see vm_unwind() */
+};
+
+struct Buffer {
+	Word *words;
+	int   size;
+	int   max;
+};
+
+
+ /* static data */
+
+static const Value **stack  = 0;	/* value stack */
+static int           sp     = 0;
+static int           nstack = 0;
+
+static Frame        *frames  = 0;	/* frame stack */
+static int           fp      = 0;
+static int           nframes = 0;
+
+#define CHURCH_CACHE_SIZE 256			/* a power of 2 */
+
+static struct {
+	Number       n;
+	const Code  *code;
+} church[CHURCH_CACHE_SIZE];			/* compiled church numerals */
+
+
+ /* function prototypes */
+
+static void compile_exp(Buffer *, const Exp *, bool);
+static const Code *compile_block(const Exp *, const Exp *);
+
+
+/* emit - appends a word to a buffer */
+
+static void emit(Buffer *buf, Word w)
+{
+	if (buf->size == buf->max) {
+		buf->max = buf->max != 0 ? 2 * buf->max : 32;
+		buf->words = realloc(buf->words, buf->max * sizeof(Word));
+		assert(buf->words != 0);
+	}
+	buf->words[buf->size++] = w;
+}
+
+
+/* emit_op - appends an instruction without operand */
+
+static void emit_op(Buffer *buf, int op)
+{
+	Word w;
+
+	w.op = op;
+	emit(buf, w);
+}
+
+
+/* emit_n - appends an instruction with an integer operand */
+
+static void emit_n(Buffer *buf, int op, int n)
+{
+	Word w;
+
+	emit_op(buf, op);
+	w.n = n;
+	emit(buf, w);
+}
+
+
+/* emit_num - appends an instruction that pushes a number */
+
+static void emit_num(Buffer *buf, Number n)
+{
+	Word w;
+
+	emit_op(buf, OP_NUM);
+	w.num = n;
+	emit(buf, w);
+}
+
+
+/* emit_ptr - appends an instruction with a pointer operand */
+
+static void emit_ptr(Buffer *buf, int op, const void *ptr)
+{
+	Word w;
+
+	emit_op(buf, op);
+	w.ptr = ptr;
+	emit(buf, w);
+}
+
+
+/* compile_exp - compiles an expression into a buffer */
+
+static void compile_exp(Buffer *buf, const Exp *exp, bool tail)
+{
+	assert(exp != 0);
+
+	switch (exp->type) {
+	case T_Exp_Symbol:
+		emit_ptr(buf, OP_SYMBOL, exp->sval);
+		break;
+
+	case T_Exp_Local:
+		emit_n(buf, OP_LOCAL, exp->nval);
+		break;
+
+	case T_Exp_Global:
+		emit_n(buf, OP_GLOBAL, exp->nval);
+		break;
+
+	case T_Exp_Quote:
+		emit_ptr(buf, OP_QUOTE, exp->child[0]);
+		break;
+
+	case T_Exp_Lambda:
+		assert(exp->child[0]->type == T_Exp_Symbol);
+		emit_ptr(buf, OP_CLOSURE, compile_block(exp, exp->child[1]));
+		break;
+
+	case T_Exp_Pair:
+		compile_exp(buf, exp->child[0], false);
+		emit_op(buf, OP_FORCE);
+		if (cheap(exp->child[1])) {
+			compile_exp(buf, exp->child[1], false);
+		} else {
+			emit_ptr(buf, OP_THUNK,
+				compile_block(exp->child[1], exp->child[1]));
+		}
+		emit_op(buf, tail ? OP_TAILAPPLY : OP_APPLY);
+		break;
+
+	case T_Exp_Assign:
+		assert(exp->child[0]->type == T_Exp_Symbol);
+		compile_exp(buf, exp->child[1], false);
+		emit_ptr(buf, OP_BIND, exp->child[0]->sval);
+		break;
+
+	case T_Exp_Seq:
+		compile_exp(buf, exp->child[0], false);
+		emit_op(buf, OP_FORCE);
+		emit_op(buf, OP_POP);
+		compile_exp(buf, exp->child[1], false);
+		emit_op(buf, OP_FORCE);
+		break;
+
+	case T_Exp_Num:
+		emit_num(buf, exp->num);
+		break;
+
+	default:
+		fwprintf(stderr, L"%s: %d: %s: illegal expression type\n",
+			__FILE__, __LINE__, "compile_exp");
+		exit(EXIT_FAILURE);
+	}
+}
+
+
+/* compile_block - compiles an expression into a code block */
+
+static const Code *compile_block(const Exp *src, const Exp *exp)
+{
+	Buffer buf = { 0, 0, 0 };
+	Code  *code = 0;
+
+	compile_exp(&buf, exp, true);
+	emit_op(&buf, OP_RETURN);
+
+	code = gc_alloc(K_Code, sizeof(*code) + (buf.size - 1) * sizeof(Word));
+	code->exp  = src;
+	code->size = buf.size;
+	memcpy(code->words, buf.words, buf.size * sizeof(Word));
+	free(buf.words);
+	if (heap_profiling) {
+		heap_note(code, sizeof(*code) + (buf.size - 1) * sizeof(Word));
+	}
+
+	return code;
+}
+
+
+/* compile - compiles an expression */
+
+const Code *compile(const Exp *exp)
+{
+	return compile_block(exp, exp);
+}
+
+
+/* push_frame - pushes a frame */
+
+static void push_frame(enum Frame_Kind kind, const Code *code,
+		       const Word *pc, Env *env, Thunk *thk)
+{
+	Frame *f = 0;
+
+	if (max_depth > 0 && fp >= max_depth) {
+		fwprintf(stderr, L"%s: evaluation depth exceeds %d\n",
+			"eval", max_depth);
+		fail();
+	}
+	if (fp == nframes) {
+		nframes = nframes != 0 ? 2 * nframes : 1024;
+		frames = realloc(frames, nframes * sizeof(*frames));
+		assert(frames != 0);
+	}
+
+	f = &frames[fp++];
+	f->kind  = kind;
+	f->code  = code;
+	f->pc    = pc;
+	f->env   = env;
+	f->thunk = thk;
+	if (thk != 0) {
+		f->tcode = thk->code;
+		f->tenv  = thk->env;
+	}
+}
+
+
+/* push - pushes a value */
+
+static void push(const Value *val)
+{
+	if (sp == nstack) {
+		nstack = nstack != 0 ? 2 * nstack : 1024;
+		stack = realloc(stack, nstack * sizeof(*stack));
+		assert(stack != 0);
+	}
+	stack[sp++] = val;
+}
+
+
+/* make_closure - makes a compiled function */
+
+static const Value *make_closure(const Code *code, Env *env)
+{
+	Value    *val = 0;
+	Function *fn  = 0;
+
+	val = alloc_value(T_Function);
+	fn  = val->data.function;
+	fn->name  = 0;
+	fn->param = code->exp->child[0];
+	fn->body  = code->exp->child[1];
+	fn->env   = env;
+	fn->apply = vm_apply;
+	fn->code  = code;
+
+	return val;
+}
+
+
+/* church_code - returns the compiled Church encoding of n */
+
+static const Code *church_code(Number n)
+{
+	const Exp *exp = 0;
+	int i = n & (CHURCH_CACHE_SIZE - 1);
+
+	if (church[i].code == 0 || church[i].n != n) {
+		exp = church_exp(n);
+		church[i].code = compile_block(exp, exp->child[1]);
+		church[i].n    = n;
+	}
+
+	return church[i].code;
+}
+
+
+/* make_promise - makes a compiled thunk */
+
+static const Value *make_promise(const Code *code, Env *env)
+{
+	Value *val = 0;
+	Thunk *thk = 0;
+
+	val = alloc_value(T_Thunk);
+	thk = val->data.thunk;
+	thk->value = 0;
+	thk->exp   = code->exp;
+	thk->env   = env;
+	thk->code  = code;
+	STAT(++counts.promised);
+
+	return val;
+}
+
+
+/* vm_run - runs code in an environment */
+
+const Value *vm_run(const Code *code, Env *env)
+{
+	const Word     *pc  = code->words;
+	const Value    *val = 0, *arg = 0;
+	const Function *fn  = 0;
+	Thunk          *thk = 0;
+	Frame          *f   = 0;
+	int             base = fp;
+
+#if defined(__GNUC__)
+	static void *labels[] = {
+		&&L_OP_LOCAL, &&L_OP_GLOBAL, &&L_OP_SYMBOL, &&L_OP_QUOTE,
+		&&L_OP_NUM, &&L_OP_CLOSURE, &&L_OP_THUNK, &&L_OP_FORCE, &&L_OP_APPLY,
+		&&L_OP_TAILAPPLY, &&L_OP_POP, &&L_OP_BIND, &&L_OP_RETURN
+	};
+#define CASE(op)	L_##op
+#define NEXT		goto *labels[(pc++)->op]
+#define DISPATCH	NEXT;
+#else
+#define CASE(op)	case op
+#define NEXT		goto dispatch
+#define DISPATCH	dispatch: switch ((pc++)->op)
+#endif
+
+	push_frame(F_Base, 0, 0, 0, 0);
+
+	DISPATCH {
+	CASE(OP_LOCAL):
+		push(lookup_local((pc++)->n, env));
+		NEXT;
+
+	CASE(OP_GLOBAL):
+		push(lookup_global((pc++)->n));
+		NEXT;
+
+	CASE(OP_SYMBOL):
+		push(lookup((Symbol)(pc++)->ptr, env));
+		NEXT;
+
+	CASE(OP_QUOTE):
+		push(make_exp_value((const Exp *)(pc++)->ptr));
+		NEXT;
+
+	CASE(OP_NUM):
+		push(make_num_value((pc++)->num));
+		NEXT;
+
+	CASE(OP_CLOSURE):
+		push(make_closure((const Code *)(pc++)->ptr, env));
+		NEXT;
+
+	CASE(OP_THUNK):
+		push(make_promise((const Code *)(pc++)->ptr, env));
+		NEXT;
+
+	CASE(OP_FORCE):
+		val = stack[sp - 1];
+		if (val->type == T_Thunk) {
+			val = compress(val);
+			STAT(val->type != T_Thunk && ++counts.cached);
+		}
+		while ((val = compress(val))->type == T_Thunk) {
+			thk = val->data.thunk;
+			if (thk->code != 0) {
+				STAT(++counts.forced);
+				/* evaluate the thunk, then force again */
+				--sp;
+				push_frame(F_Update, code, pc - 1, env, thk);
+				gc_poll();
+				code = thk->code;
+				env  = thk->env;
+				pc   = code->words;
+				blackhole(thk);
+				NEXT;
+			} else {
+				push_frame(F_Native, code, pc, env, 0);
+				val = force(val);
+				--fp;
+			}
+		}
+		stack[sp - 1] = val;
+		NEXT;
+
+	CASE(OP_APPLY):
+	CASE(OP_TAILAPPLY):
+		arg = stack[--sp];
+		val = stack[--sp];
+		if (arg->type == T_Thunk && val->type == T_Function
+		    && num_strict(val->data.function->apply)
+		    && (arg = compress(arg))->type == T_Thunk
+		    && arg->data.thunk->code != 0) {
+			/* force the number here, not in num_of(), then
+			   apply again */
+			thk = arg->data.thunk;
+			++sp;
+			push_frame(F_Update, code, pc - 1, env, thk);
+			gc_poll();
+			code = thk->code;
+			env  = thk->env;
+			pc   = code->words;
+			blackhole(thk);
+			NEXT;
+		}
+		/* every argument instruction has one operand */
+		if (pc[-3].op != OP_THUNK) {
+			STAT(++counts.avoided);
+		}
+		if (val->type == T_Num) {
+			val = make_closure(church_code(val->data.num),
+				get_global_environment());
+		}
+		fn  = the(T_Function, val);
+		STAT_APPLY(fn);
+		if (fn->code != 0) {
+			if (pc[-1].op == OP_APPLY) {
+				push_frame(F_Call, code, pc, env, 0);
+			}
+			env  = link(fn->param->sval, arg, fn->env);
+			code = fn->code;
+			pc   = code->words;
+			push_frame(F_Native, code, pc, env, 0);
+			gc_poll();
+			--fp;
+		} else {
+			push_frame(F_Native, code, pc, env, 0);
+			push(fn->apply(fn, arg));
+			--fp;
+		}
+		NEXT;
+
+	CASE(OP_POP):
+		--sp;
+		NEXT;
+
+	CASE(OP_BIND):
+		stack[sp - 1] = bind((Symbol)(pc++)->ptr, stack[sp - 1],
+			get_global_environment());
+		NEXT;
+
+	CASE(OP_RETURN):
+		f = &frames[--fp];
+		code = f->code;
+		pc   = f->pc;
+		env  = f->env;
+		switch (f->kind) {
+		case F_Update:
+			f->thunk->value = stack[sp - 1];
+			NEXT;
+		case F_Call:
+			NEXT;
+		case F_Base:
+			assert(fp == base);
+			return stack[--sp];
+		default:
+			assert(!"bad frame");
+		}
+	}
+
+#undef CASE
+#undef NEXT
+#undef DISPATCH
+
+	return 0;
+}
+
+
+/* vm_eval - compiles and runs an expression */
+
+const Value *vm_eval(const Exp *exp, Env *env)
+{
+	return vm_run(compile(exp), env);
+}
+
+
+/* vm_apply - applies a compiled function */
+
+const Value *vm_apply(const Function *fn, const Value *arg)
+{
+	assert(fn->code != 0);
+
+	return vm_run(fn->code, link(fn->param->sval, arg, fn->env));
+}
+
+
+/* scan_code - marks the objects referred to by a code block */
+
+void scan_code(const Code *code)
+{
+	const Word *pc = code->words, *end = code->words + code->size;
+
+	gc_mark(code->exp);
+
+	while (pc < end) {
+		switch ((pc++)->op) {
+		case OP_QUOTE:
+		case OP_CLOSURE:
+		case OP_THUNK:
+			gc_mark((pc++)->ptr);
+			break;
+		case OP_LOCAL:
+		case OP_GLOBAL:
+		case OP_NUM:
+		case OP_SYMBOL:
+		case OP_BIND:
+			pc++;
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+
+/* scan_vm - marks the objects on the stacks of the machine */
+
+void scan_vm(void)
+{
+	int i;
+
+	for (i = 0; i < sp; i++) {
+		gc_mark(stack[i]);
+	}
+	for (i = 0; i < CHURCH_CACHE_SIZE; i++) {
+		gc_mark(church[i].code);
+	}
+	for (i = 0; i < fp; i++) {
+		gc_mark(frames[i].code);
+		gc_mark(frames[i].env);
+		if (frames[i].thunk != 0) {
+			gc_mark(VALUE_OF(frames[i].thunk));
+			gc_mark(frames[i].tcode);
+			gc_mark(frames[i].tenv);
+		}
+	}
+}
+
+
+/* vm_unwind - gives back the thunks under evaluation, and empties the
+   stacks of the machine; called when an evaluation fails */
+
+void vm_unwind(void)
+{
+	const Frame *f = 0;
+
+	while (fp > 0) {
+		f = &frames[--fp];
+		if (f->kind == F_Update) {
+			f->thunk->exp  = f->tcode->exp;
+			f->thunk->env  = f->tenv;
+			f->thunk->code = f->tcode;
+		}
+	}
+	sp = 0;
+}
@@ -0,0 +1,25 @@
+#ifndef _VM_H_INCLUDED_
+#define _VM_H_INCLUDED_
+#include "types.h"
+/*++
+/* NAME
+/*	vm 3h
+/* SUMMARY
+/*	Bytecode compiler and virtual machine.
+/* DESCRIPTION
+/* .nf
+
+ /* Function prototypes */
+
+const Code  *compile(const Exp *exp);
+const Value *vm_eval(const Exp *exp, Env *env);
+const Value *vm_run(const Code *code, Env *env);
+const Value *vm_apply(const Function *fn, const Value *arg);
+void	     scan_code(const Code *code);
+void	     scan_vm(void);
+void	     vm_unwind(void);
+
+/* AUTHOR
+/*	Brent Harp
+/*--*/
+#endif